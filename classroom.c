@@ -1,26 +1,77 @@
 /* classroom_dsa.c
    DSA-Based Classroom Communication & Syllabus Management System (Console)
    Features: Hash table users, Graph chat, Message queues, BST syllabus,
-             Announcement stack, Min-heap assignments, File save/load
-   Compile: gcc -std=c99 -O2 classroom_dsa.c -o classroom_dsa
+             Announcement ring feed, Min-heap assignments, File save/load
+   Compile: gcc -std=c99 -O2 -pthread classroom_dsa.c -o classroom_dsa
 */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <time.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <sched.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
-#define MAX_NAME 642
+#define MAX_NAME 642 // usernames and passwords, including the terminator
 
-#define HASH_SIZE 101
+#define USER_TABLE_INITIAL 64 // buckets; always a power of two
+#define USER_REHASH_STEP 4    // buckets migrated per insert while rehashing
+#define MAX_USER_ID (1 << 24) // bound for the dense id index
+#define USER_ID_GAP_MAX 4096  // how far past the highest id a loaded or imported id may be
+#define USER_PAGE_RECORDS 256 // users per contiguous record page
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define DIGEST_LEN 32
+#define CONV_SEGMENT_MIN 512         // first log segment of a conversation
+#define CONV_SEGMENT_MAX (16 * 1024) // segments double up to this size
+#define MSG_PAGE_SIZE 20             // messages shown per chat page
+#define MAILBOX_DRAIN_AT 1024 // pending messages after which a sender drains the mailbox
+#define CHAT_RETAIN_MESSAGES 10000 // newest messages kept per conversation, 0 = all
+#define CHAT_RETAIN_DAYS 365       // messages older than this are dropped, 0 = never
+#define SNAPSHOT_FILE "classroom.snap"
+#define WAL_FILE "classroom.wal"             // segments are WAL_FILE.NNNNNN
+#define WAL_GROUP_BYTES (64 * 1024)          // flush a group once this much is buffered
+#define WAL_GROUP_USEC 2000                  // ... or once its oldest record is this old
+#define WAL_CHECKPOINT_BYTES (8 * 1024 * 1024) // segment size that triggers a checkpoint
 #define MAX_TEXT 512
 #define INITIAL_USER_CAP 100
 #define MAX_SUBJECT_NAME 64
-#define ASSIGNMENT_MAX 500
+#define ANN_RETENTION 1024 // announcements kept in the feed, power of two
+#define ANN_PAGE_SIZE 10
+#define SEARCH_TERM_MAX 32 // indexed word length, including the terminator
+#define SEARCH_MAX_TOKENS 256 // words indexed per document, a multiple of 64
+#define SEARCH_MAX_TERMS 16 // words per query
+#define SEARCH_MAX_HITS 20
+#define SEARCH_SKIP_EVERY 64 // postings entries per skip entry
+#define HEAP_ARITY 4 // children per assignment heap node
+#define MAX_ASSIGNMENT_ID (1 << 24) // bound for the id -> heap position map
 
 /* =========================
    Utility
    ========================= */
+void wal_commit_point(void);
+int checkpoint(int background);
+
 void clear_input_buffer() {
     int c;
     while ((c = getchar()) != '\n' && c != EOF) {}
@@ -28,6 +79,7 @@ void clear_input_buffer() {
 
 int read_int() {
     int v;
+    wal_commit_point();
     int rc = scanf("%d", &v);
     if (rc == 1) { clear_input_buffer(); return v; }
     if (rc == EOF) {
@@ -38,492 +90,3428 @@ int read_int() {
     return -1;
 }
 
+/* Read one line into out. A longer line is cut to maxlen-1 characters and
+   the rest is discarded, so it cannot answer the next prompt. */
 void read_str(const char *prompt, char *out, int maxlen) {
+    wal_commit_point();
     printf("%s", prompt);
     if (!fgets(out, maxlen, stdin)) { out[0] = '\0'; return; }
     size_t n = strlen(out);
     if (n && out[n-1] == '\n') out[n-1] = '\0';
+    else if (!feof(stdin)) {
+        clear_input_buffer();
+        printf("(input cut to %d characters)\n", maxlen - 1);
+    }
+}
+
+/* Split line in place on sep; returns the number of fields stored in out. */
+int split_fields(char* line, char sep, char** out, int max) {
+    int n = 0;
+    char* p = line;
+    while (n < max) {
+        out[n++] = p;
+        p = strchr(p, sep);
+        if (!p) break;
+        *p++ = '\0';
+    }
+    return p ? n + 1 : n; // n + 1 flags extra fields beyond max
+}
+
+/* =========================
+   Memory pools - where the memory goes
+   Every long-lived allocation is charged to the pool of the subsystem that
+   owns it: arena blocks, slab objects and the growable arrays. A pool
+   tracks live bytes (what malloc handed out, slack included), live
+   objects, the high-water mark and the number of malloc/realloc calls.
+   The admin panel, the `stats` command and the benchmark print them, and
+   after classroom_teardown() every pool reads zero.
+   Counters are relaxed atomics: message logs and mailboxes allocate under
+   per-conversation and per-mailbox locks, in parallel.
+   ========================= */
+
+enum { MEM_OTHER, MEM_USERS, MEM_CHAT, MEM_MESSAGES, MEM_MAILBOXES, MEM_SEARCH, MEM_SYLLABUS,
+       MEM_ANNOUNCEMENTS, MEM_ASSIGNMENTS, MEM_POOLS };
+
+typedef struct MemPool {
+    const char* name;
+    size_t bytes;   // live bytes obtained from malloc
+    size_t peak;    // high-water mark of bytes
+    size_t objects; // live objects handed out
+    size_t calls;   // malloc/realloc calls so far
+} __attribute__((aligned(64))) MemPool; // one cache line each: pools are charged from different threads
+
+MemPool mem_pools[MEM_POOLS] = {
+    { "other", 0, 0, 0, 0 }, { "users", 0, 0, 0, 0 }, { "chat graph", 0, 0, 0, 0 },
+    { "message logs", 0, 0, 0, 0 }, { "mailboxes", 0, 0, 0, 0 }, { "search index", 0, 0, 0, 0 },
+    { "syllabus", 0, 0, 0, 0 }, { "announcements", 0, 0, 0, 0 }, { "assignments", 0, 0, 0, 0 }
+};
+
+/* Add bytes and objects (either may be negative) to a pool. */
+static void mem_charge(int pool, long bytes, long objects, int calls) {
+    MemPool* p = &mem_pools[pool];
+    size_t now = __atomic_add_fetch(&p->bytes, (size_t)bytes, __ATOMIC_RELAXED);
+    if (objects) __atomic_add_fetch(&p->objects, (size_t)objects, __ATOMIC_RELAXED);
+    if (calls) __atomic_add_fetch(&p->calls, (size_t)calls, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&p->peak, __ATOMIC_RELAXED);
+    while (bytes > 0 && now > peak
+           && !__atomic_compare_exchange_n(&p->peak, &peak, now, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+/* One object of n bytes from malloc, charged to pool. */
+void* mem_alloc(int pool, size_t n) {
+    void* p = malloc(n);
+    if (p) mem_charge(pool, (long)n, 1, 1);
+    return p;
+}
+
+void* mem_calloc(int pool, size_t n) {
+    void* p = calloc(1, n);
+    if (p) mem_charge(pool, (long)n, 1, 1);
+    return p;
+}
+
+void mem_free(int pool, void* p, size_t n) {
+    if (!p) return;
+    free(p);
+    mem_charge(pool, -(long)n, -1, 0);
+}
+
+/* Resize an array charged to pool from old_n to new_n bytes; a NULL p
+   starts a new one. */
+void* mem_realloc(int pool, void* p, size_t old_n, size_t new_n) {
+    void* q = realloc(p, new_n);
+    if (q) mem_charge(pool, (long)new_n - (long)(p ? old_n : 0), p ? 0 : 1, 1);
+    return q;
+}
+
+/* =========================
+   Arena - bump allocator over a chain of blocks.
+   Objects are never freed individually; the whole arena goes at once.
+   Blocks are charged to the arena's pool.
+   ========================= */
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t used, cap;
+    char data[];
+} ArenaBlock;
+
+typedef struct Arena {
+    ArenaBlock* head;
+    size_t block_size;
+    int pool;       // MemPool charged for the blocks
+    size_t objects; // allocations made, live until arena_free
+} Arena;
+
+#define ARENA_INIT(pool) { NULL, 0, (pool), 0 }
+
+void* arena_alloc(Arena* a, size_t n, size_t align) {
+    ArenaBlock* b = a->head;
+    size_t off = b ? (b->used + align - 1) & ~(align - 1) : 0;
+    if (!b || off + n > b->cap) {
+        size_t cap = a->block_size ? a->block_size : ARENA_BLOCK_SIZE;
+        if (cap < n) cap = n;
+        b = (ArenaBlock*)malloc(sizeof(ArenaBlock) + cap);
+        mem_charge(a->pool, (long)(sizeof(ArenaBlock) + cap), 0, 1);
+        b->cap = cap; b->used = 0;
+        b->next = a->head;
+        a->head = b;
+        off = 0;
+    }
+    b->used = off + n;
+    a->objects++;
+    mem_charge(a->pool, 0, 1, 0);
+    return b->data + off;
+}
+
+char* arena_strdup(Arena* a, const char* s) {
+    size_t n = strlen(s) + 1;
+    char* out = (char*)arena_alloc(a, n, 1);
+    memcpy(out, s, n);
+    return out;
+}
+
+void arena_free(Arena* a) {
+    ArenaBlock* b = a->head;
+    long bytes = 0;
+    while (b) { ArenaBlock* nx = b->next; bytes += (long)(sizeof(ArenaBlock) + b->cap); free(b); b = nx; }
+    mem_charge(a->pool, -bytes, -(long)a->objects, 0);
+    a->head = NULL;
+    a->objects = 0;
+}
+
+/* Fixed-size objects that are freed one at a time: carved from an arena
+   and recycled through a free list, so churn costs no allocator calls. */
+typedef struct Slab {
+    Arena arena;
+    size_t size; // at least sizeof(void*)
+    void* free_list;
+} Slab;
+
+void* slab_alloc(Slab* s) {
+    if (!s->free_list) return arena_alloc(&s->arena, s->size, 8);
+    void* p = s->free_list;
+    s->free_list = *(void**)p;
+    s->arena.objects++;
+    mem_charge(s->arena.pool, 0, 1, 0);
+    return p;
+}
+
+void slab_free(Slab* s, void* p) {
+    *(void**)p = s->free_list;
+    s->free_list = p;
+    s->arena.objects--;
+    mem_charge(s->arena.pool, 0, -1, 0);
+}
+
+void slab_reset(Slab* s) {
+    arena_free(&s->arena);
+    s->free_list = NULL;
+}
+
+/* =========================
+   Radix tree - prefix index over names
+   A compressed trie: each edge label is a slice of a key the caller keeps
+   alive (an interned username, a subject or topic name), so inserting and
+   splitting edges copies no text. Children are kept sorted by first byte.
+   Reaching a prefix costs O(prefix length), and listing the first k
+   matches in order visits only the nodes on the way to them, however
+   many names are indexed. A key maps to one or more ints. Nodes and their
+   child arrays live in the tree's arena (a grown array leaves the old one
+   behind), so a whole tree is dropped with one arena_free.
+   ========================= */
+
+#define RADIX_MAX_KEY MAX_NAME // longest indexed name, including the terminator (topics: 128)
+
+typedef struct RadixNode {
+    const char* label; // edge from the parent; not terminated
+    uint32_t len;
+    uint16_t nkids, kcap;
+    struct RadixNode** kids; // sorted by label[0]
+    int value;   // 0 = no key ends here
+    int nmore;   // further values for the same key (a topic in several subjects)
+    int* more;
+} RadixNode;
+
+typedef struct RadixTree {
+    RadixNode root;
+    Arena nodes;
+    size_t keys;
+} RadixTree;
+
+typedef struct RadixMatch {
+    char key[RADIX_MAX_KEY];
+    int value;
+} RadixMatch;
+
+/* Index of the child starting with c, or -(insert position) - 1. */
+static int radix_kid(const RadixNode* n, unsigned char c) {
+    int lo = 0, hi = n->nkids - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        unsigned char m = (unsigned char)n->kids[mid]->label[0];
+        if (m == c) return mid;
+        if (m < c) lo = mid + 1; else hi = mid - 1;
+    }
+    return -lo - 1;
+}
+
+static RadixNode* radix_node(RadixTree* t, const char* label, uint32_t len) {
+    RadixNode* n = (RadixNode*)arena_alloc(&t->nodes, sizeof(RadixNode), sizeof(void*));
+    memset(n, 0, sizeof(*n));
+    n->label = label;
+    n->len = len;
+    return n;
+}
+
+static void radix_attach(RadixTree* t, RadixNode* n, int pos, RadixNode* kid) {
+    if (n->nkids == n->kcap) {
+        n->kcap = n->kcap ? (uint16_t)(n->kcap * 2) : 2;
+        RadixNode** kids = (RadixNode**)arena_alloc(&t->nodes, n->kcap * sizeof(RadixNode*), sizeof(void*));
+        if (n->nkids) memcpy(kids, n->kids, n->nkids * sizeof(RadixNode*));
+        n->kids = kids;
+    }
+    memmove(n->kids + pos + 1, n->kids + pos, (size_t)(n->nkids - pos) * sizeof(RadixNode*));
+    n->kids[pos] = kid;
+    n->nkids++;
+}
+
+/* Map key to value (value != 0). key must stay valid and unchanged for
+   the life of the tree. */
+void radix_insert(RadixTree* t, const char* key, int value) {
+    size_t klen = strlen(key), pos = 0;
+    if (!klen || klen >= RADIX_MAX_KEY) return;
+    RadixNode* n = &t->root;
+    while (pos < klen) {
+        int i = radix_kid(n, (unsigned char)key[pos]);
+        if (i < 0) {
+            RadixNode* leaf = radix_node(t, key + pos, (uint32_t)(klen - pos));
+            radix_attach(t, n, -i - 1, leaf);
+            n = leaf;
+            break;
+        }
+        RadixNode* c = n->kids[i];
+        uint32_t l = 1;
+        while (l < c->len && pos + l < klen && c->label[l] == key[pos + l]) l++;
+        if (l < c->len) { // split the edge: c keeps the tail under a new middle node
+            RadixNode* mid = radix_node(t, c->label, l);
+            c->label += l;
+            c->len -= l;
+            radix_attach(t, mid, 0, c);
+            n->kids[i] = mid;
+            c = mid;
+        }
+        n = c;
+        pos += l;
+    }
+    if (!n->value) { n->value = value; t->keys++; return; }
+    if (n->value == value) return;
+    for (int k = 0; k < n->nmore; ++k) if (n->more[k] == value) return;
+    if (!(n->nmore & (n->nmore - 1))) { // full at 0, 1, 2, 4, ...: double
+        int* more = (int*)arena_alloc(&t->nodes, (size_t)(n->nmore ? 2 * n->nmore : 1) * sizeof(int), sizeof(int));
+        if (n->nmore) memcpy(more, n->more, (size_t)n->nmore * sizeof(int));
+        n->more = more;
+    }
+    n->more[n->nmore++] = value;
+}
+
+void radix_reset(RadixTree* t) {
+    arena_free(&t->nodes);
+    memset(&t->root, 0, sizeof(t->root));
+    t->keys = 0;
+}
+
+#define RADIX_INIT(pool) { { NULL, 0, 0, 0, NULL, 0, 0, NULL }, ARENA_INIT(pool), 0 }
+
+static int radix_collect(const RadixNode* n, char* buf, size_t len, RadixMatch* out, int k, int found) {
+    if (n->value) {
+        for (int v = -1; v < n->nmore && found < k; ++v) {
+            memcpy(out[found].key, buf, len);
+            out[found].key[len] = '\0';
+            out[found++].value = v < 0 ? n->value : n->more[v];
+        }
+    }
+    for (int i = 0; i < n->nkids && found < k; ++i) {
+        const RadixNode* c = n->kids[i];
+        memcpy(buf + len, c->label, c->len);
+        found = radix_collect(c, buf, len + c->len, out, k, found);
+    }
+    return found;
+}
+
+/* Up to k keys starting with prefix, in byte order. Returns how many. */
+int radix_prefix(const RadixTree* t, const char* prefix, RadixMatch* out, int k) {
+    char buf[RADIX_MAX_KEY];
+    size_t plen = strlen(prefix), pos = 0;
+    if (plen >= RADIX_MAX_KEY || k <= 0) return 0;
+    const RadixNode* n = &t->root;
+    while (pos < plen) {
+        int i = radix_kid(n, (unsigned char)prefix[pos]);
+        if (i < 0) return 0;
+        const RadixNode* c = n->kids[i];
+        uint32_t l = 1;
+        while (l < c->len && pos + l < plen && c->label[l] == prefix[pos + l]) l++;
+        if (pos + l < plen && l < c->len) return 0; // diverges inside the edge
+        memcpy(buf + pos, c->label, c->len);
+        pos += c->len;
+        n = c;
+    }
+    return radix_collect(n, buf, pos, out, k, 0);
+}
+
+/* Matches for the longest prefix of typed that has any, for "did you mean". */
+int radix_suggest(const RadixTree* t, const char* typed, RadixMatch* out, int k) {
+    char prefix[RADIX_MAX_KEY];
+    size_t n = strlen(typed);
+    if (n >= RADIX_MAX_KEY) n = RADIX_MAX_KEY - 1;
+    memcpy(prefix, typed, n);
+    for (; n > 0; --n) {
+        prefix[n] = '\0';
+        int found = radix_prefix(t, prefix, out, k);
+        if (found) return found;
+    }
+    return 0;
+}
+
+/* =========================
+   SHA-256 - credentials are kept only as a digest
+   ========================= */
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
+    0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
+    0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+    0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
+    0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
+    0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+    0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
+    0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
+};
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(uint32_t h[8], const unsigned char* p) {
+    uint32_t w[64], v[8];
+    for (int i = 0; i < 16; ++i)
+        w[i] = (uint32_t)p[4*i] << 24 | (uint32_t)p[4*i+1] << 16 | (uint32_t)p[4*i+2] << 8 | p[4*i+3];
+    for (int i = 16; i < 64; ++i) {
+        uint32_t s0 = ROTR32(w[i-15], 7) ^ ROTR32(w[i-15], 18) ^ (w[i-15] >> 3);
+        uint32_t s1 = ROTR32(w[i-2], 17) ^ ROTR32(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+    memcpy(v, h, sizeof(v));
+    for (int i = 0; i < 64; ++i) {
+        uint32_t t1 = v[7] + (ROTR32(v[4], 6) ^ ROTR32(v[4], 11) ^ ROTR32(v[4], 25))
+                    + ((v[4] & v[5]) ^ (~v[4] & v[6])) + sha256_k[i] + w[i];
+        uint32_t t2 = (ROTR32(v[0], 2) ^ ROTR32(v[0], 13) ^ ROTR32(v[0], 22))
+                    + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+        memmove(v + 1, v, 7 * sizeof(uint32_t));
+        v[4] += t1;
+        v[0] = t1 + t2;
+    }
+    for (int i = 0; i < 8; ++i) h[i] += v[i];
+}
+
+void sha256(const void* data, size_t len, unsigned char out[DIGEST_LEN]) {
+    uint32_t h[8] = {0x6a09e667,0xbb67ae85,0x3c6ef372,0xa54ff53a,0x510e527f,0x9b05688c,0x1f83d9ab,0x5be0cd19};
+    const unsigned char* d = (const unsigned char*)data;
+    unsigned char block[64];
+    uint64_t bits = (uint64_t)len * 8;
+    size_t total = (len + 9 + 63) / 64 * 64;
+    for (size_t off = 0; off < total; off += 64) {
+        if (off + 64 <= len) { sha256_block(h, d + off); continue; }
+        for (size_t i = 0; i < 64; ++i) {
+            size_t at = off + i;
+            block[i] = at < len ? d[at] : at == len ? 0x80 : 0;
+        }
+        if (off + 64 == total)
+            for (int i = 0; i < 8; ++i) block[56+i] = (unsigned char)(bits >> (56 - 8*i));
+        sha256_block(h, block);
+    }
+    for (int i = 0; i < 8; ++i) {
+        out[4*i] = (unsigned char)(h[i] >> 24); out[4*i+1] = (unsigned char)(h[i] >> 16);
+        out[4*i+2] = (unsigned char)(h[i] >> 8); out[4*i+3] = (unsigned char)h[i];
+    }
+}
+
+/* =========================
+   Locks - shared state is only contended in server mode
+   Interactive and batch mode run on one thread and take these uncontended.
+   Every server command holds state_lock shared for its whole run, so a
+   checkpoint can take it exclusively and fork from a consistent image.
+   Below that, each subsystem has its own lock:
+       users_lock (rw)     user table, id index, user arena
+       chat_lock (rw)      adjacency lists and edge map; each Mailbox has
+                           a drain mutex for its single consumer and each
+                           Conversation a mutex for its log, so traffic on
+                           different pairs proceeds in parallel
+       chat_csr_lock (rw)  CSR peer snapshot, taken with chat_lock shared
+       syllabus_lock (rw)  subject registry and topic trees
+       ann_lock (rw)       announcement ring and cursors
+       assign_lock (rw)    assignment heap and submission store
+       search_lock (rw)    inverted index: terms, postings, document table
+       wal_lock            WAL group buffer, segment fd and LSNs
+   Order: state -> assign -> chat -> chat_csr -> mailbox -> conversation
+   -> ann -> search -> users -> wal. A thread never holds two subsystem
+   locks except in that order.
+   ========================= */
+
+pthread_rwlock_t state_lock = PTHREAD_RWLOCK_INITIALIZER;
+int state_quiesce = 0; // set while a checkpoint waits, so it is not starved by readers
+pthread_rwlock_t users_lock = PTHREAD_RWLOCK_INITIALIZER;
+pthread_rwlock_t chat_lock = PTHREAD_RWLOCK_INITIALIZER;
+pthread_rwlock_t syllabus_lock = PTHREAD_RWLOCK_INITIALIZER;
+pthread_rwlock_t ann_lock = PTHREAD_RWLOCK_INITIALIZER;
+pthread_rwlock_t assign_lock = PTHREAD_RWLOCK_INITIALIZER;
+pthread_rwlock_t search_lock = PTHREAD_RWLOCK_INITIALIZER;
+pthread_mutex_t wal_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void state_enter(void) {
+    while (__atomic_load_n(&state_quiesce, __ATOMIC_ACQUIRE)) sched_yield();
+    pthread_rwlock_rdlock(&state_lock);
+}
+
+void state_leave(void) { pthread_rwlock_unlock(&state_lock); }
+
+void state_quiesce_begin(void) {
+    __atomic_store_n(&state_quiesce, 1, __ATOMIC_RELEASE);
+    pthread_rwlock_wrlock(&state_lock);
+}
+
+void state_quiesce_end(void) {
+    pthread_rwlock_unlock(&state_lock);
+    __atomic_store_n(&state_quiesce, 0, __ATOMIC_RELEASE);
+}
+
+/* =========================
+   Write-ahead log - record encoding and group commit
+   Each mutation appends [u32 len][u32 crc32][u64 lsn][u8 type][payload] to
+   an in-memory group. The group is written and fsync'd once it reaches
+   WAL_GROUP_BYTES or WAL_GROUP_USEC, and at every commit point (before the
+   program blocks for input), so many mutations share one fsync.
+   Payload fields follow wal_formats: i = int32, l = int64,
+   s = u32 length + bytes + '\0', b = DIGEST_LEN raw bytes.
+   ========================= */
+
+#define WAL_HEADER 17
+
+enum { WAL_USER = 1, WAL_MESSAGE, WAL_ANNOUNCE, WAL_SUBJECT, WAL_TOPIC, WAL_COMPLETE,
+       WAL_ASSIGN, WAL_SUBMIT, WAL_DUE, WAL_UNASSIGN, WAL_TYPES };
+
+static const char* wal_formats[WAL_TYPES] = {
+    "",     // unused
+    "iisb", // user: id, role, username, digest
+    "iils", // message: from, to, ts, text
+    "ls",   // announcement: ts, text
+    "s",    // subject: name
+    "ss",   // topic: subject, topic
+    "ss",   // complete: subject, topic
+    "iiss", // assignment: id, due, title, description
+    "iils", // submission: assignment id, student id, ts, filename
+    "ii",   // due date change: assignment id, due
+    "i"     // assignment removal: assignment id
+};
+
+int wal_fd = -1;
+int wal_suspended = 0;      // > 0 while loading or replaying: nothing is logged
+unsigned wal_seg = 1;       // segment being appended to
+unsigned wal_first_seg = 1; // oldest segment not covered by the snapshot
+uint64_t wal_last_lsn = 0;
+uint64_t wal_synced_lsn = 0; // every record up to here is on disk
+size_t wal_seg_bytes = 0;
+char* wal_buf = NULL;
+size_t wal_buf_len = 0, wal_buf_cap = 0;
+struct timespec wal_group_start;
+
+uint32_t crc32_update(uint32_t crc, const void* data, size_t n) {
+    static uint32_t table[256];
+    if (!table[1])
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+    const unsigned char* p = (const unsigned char*)data;
+    crc = ~crc;
+    while (n--) crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void wal_put(const void* p, size_t n) {
+    if (wal_buf_len + n > wal_buf_cap) {
+        size_t cap = wal_buf_cap ? wal_buf_cap : WAL_GROUP_BYTES;
+        while (cap < wal_buf_len + n) cap *= 2;
+        wal_buf = (char*)mem_realloc(MEM_OTHER, wal_buf, wal_buf_cap, cap);
+        wal_buf_cap = cap;
+    }
+    memcpy(wal_buf + wal_buf_len, p, n);
+    wal_buf_len += n;
+}
+
+/* Write out and fsync the pending group; caller holds wal_lock. */
+static int wal_write_group(void) {
+    if (wal_fd < 0 || !wal_buf_len) { wal_synced_lsn = wal_last_lsn; return 0; }
+    size_t off = 0;
+    while (off < wal_buf_len) {
+        ssize_t w = write(wal_fd, wal_buf + off, wal_buf_len - off);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) { printf("WAL write failed; recent changes are not durable.\n"); return -1; }
+        off += (size_t)w;
+    }
+    if (fsync(wal_fd) != 0) { printf("WAL fsync failed; recent changes are not durable.\n"); return -1; }
+    wal_seg_bytes += wal_buf_len;
+    wal_buf_len = 0;
+    wal_synced_lsn = wal_last_lsn;
+    return 0;
+}
+
+int wal_sync(void) {
+    pthread_mutex_lock(&wal_lock);
+    int rc = wal_write_group();
+    pthread_mutex_unlock(&wal_lock);
+    return rc;
+}
+
+/* Group commit: make sure everything up to lsn is durable. Threads that
+   arrive while another one is in fsync usually find their records
+   already covered when they get the lock. */
+int wal_commit_upto(uint64_t lsn) {
+    pthread_mutex_lock(&wal_lock);
+    int rc = wal_synced_lsn >= lsn ? 0 : wal_write_group();
+    pthread_mutex_unlock(&wal_lock);
+    return rc;
+}
+
+uint64_t wal_current_lsn(void) {
+    pthread_mutex_lock(&wal_lock);
+    uint64_t lsn = wal_last_lsn;
+    pthread_mutex_unlock(&wal_lock);
+    return lsn;
+}
+
+void wal_log(int type, ...) {
+    if (wal_fd < 0 || wal_suspended) return;
+    pthread_mutex_lock(&wal_lock);
+    size_t start = wal_buf_len;
+    char hdr[WAL_HEADER] = {0};
+    wal_put(hdr, WAL_HEADER);
+    va_list ap;
+    va_start(ap, type);
+    for (const char* f = wal_formats[type]; *f; ++f) {
+        if (*f == 'i') { int32_t v = (int32_t)va_arg(ap, int); wal_put(&v, 4); }
+        else if (*f == 'l') { int64_t v = va_arg(ap, int64_t); wal_put(&v, 8); }
+        else if (*f == 's') {
+            const char* str = va_arg(ap, const char*);
+            uint32_t n = (uint32_t)strlen(str);
+            wal_put(&n, 4); wal_put(str, n + 1);
+        } else if (*f == 'b') wal_put(va_arg(ap, const unsigned char*), DIGEST_LEN);
+    }
+    va_end(ap);
+    uint32_t len = (uint32_t)(wal_buf_len - start - WAL_HEADER);
+    uint64_t lsn = ++wal_last_lsn;
+    char* h = wal_buf + start;
+    memcpy(h, &len, 4);
+    memcpy(h + 8, &lsn, 8);
+    h[16] = (char)type;
+    uint32_t crc = crc32_update(0, h + 8, len + 9);
+    memcpy(h + 4, &crc, 4);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (start == 0) wal_group_start = now;
+    long usec = (now.tv_sec - wal_group_start.tv_sec) * 1000000L + (now.tv_nsec - wal_group_start.tv_nsec) / 1000;
+    if (wal_buf_len >= WAL_GROUP_BYTES || usec >= WAL_GROUP_USEC) wal_write_group();
+    pthread_mutex_unlock(&wal_lock);
 }
 
 /* =========================
    Users - Hash table with chaining
+   The table grows by doubling and rehashes incrementally: while a resize is
+   in progress both tables are live and every insert migrates a few buckets
+   from the old one, so no single call pays for the whole table.
+   A dense id -> User* array answers find_user_by_id in O(1).
+   Records are packed USER_PAGE_RECORDS to a page, usernames are interned in
+   a shared arena at their real length and passwords are kept only as a
+   SHA-256 digest salted with the username (no random salt), so a user
+   costs well under 100 bytes plus the name instead of two fixed buffers.
    ========================= */
 
 typedef enum {ROLE_STUDENT, ROLE_TEACHER, ROLE_ADMIN} Role;
 
 typedef struct User {
-    char username[MAX_NAME];
-    char password[MAX_NAME];
-    Role role;
-    int id; // unique numeric id
+    const char* username; // interned in user_arena
     struct User *next; // for chaining
+    int id; // unique numeric id
+    Role role;
+    unsigned char pw_digest[DIGEST_LEN]; // sha256(username '\0' password)
 } User;
 
-User* user_table[HASH_SIZE];
+typedef struct UserPage {
+    struct UserPage* next;
+    int used;
+    User recs[USER_PAGE_RECORDS];
+} UserPage;
+
+typedef struct UserTable {
+    User** buckets;
+    unsigned int size; // power of two (0 = unused)
+    unsigned int used;
+} UserTable;
+
+UserTable user_table[2];  // [1] is only live while rehashing into it
+long user_rehash_idx = -1; // next bucket of user_table[0] to migrate, -1 if idle
+User** users_by_id = NULL; // dense index, slot i holds the user with id i
+int users_by_id_cap = 0;
 int next_user_id = 1;
 int total_users = 0;
+UserPage* user_pages = NULL;
+Arena user_arena = ARENA_INIT(MEM_USERS); // record pages and interned names
 
 unsigned int hash_username(const char *s) {
     unsigned long h = 5381;
     while (*s) h = ((h << 5) + h) + (unsigned char)(*s++);
-    return (unsigned int)(h % HASH_SIZE);
+    return (unsigned int)h;
 }
 
-User* find_user_by_name(const char *username) {
-    unsigned int h = hash_username(username);
-    User* cur = user_table[h];
-    while (cur) {
-        if (strcmp(cur->username, username) == 0) return cur;
-        cur = cur->next;
+void user_table_init(UserTable* t, unsigned int size) {
+    t->buckets = (User**)mem_calloc(MEM_USERS, size * sizeof(User*));
+    t->size = size;
+    t->used = 0;
+}
+
+/* Move up to n buckets from the old table into the new one. */
+void user_rehash_step(int n) {
+    if (user_rehash_idx < 0) return;
+    UserTable* from = &user_table[0];
+    UserTable* to = &user_table[1];
+    while (n-- > 0 && (unsigned long)user_rehash_idx < from->size) {
+        User* cur = from->buckets[user_rehash_idx];
+        while (cur) {
+            User* nx = cur->next;
+            unsigned int h = hash_username(cur->username) & (to->size - 1);
+            cur->next = to->buckets[h];
+            to->buckets[h] = cur;
+            from->used--; to->used++;
+            cur = nx;
+        }
+        from->buckets[user_rehash_idx++] = NULL;
+    }
+    if ((unsigned long)user_rehash_idx >= from->size) {
+        mem_free(MEM_USERS, from->buckets, from->size * sizeof(User*));
+        user_table[0] = *to;
+        to->buckets = NULL; to->size = to->used = 0;
+        user_rehash_idx = -1;
     }
-    return NULL;
 }
 
-User* find_user_by_id(int id) {
-    for (int i = 0; i < HASH_SIZE; ++i) {
-        User* cur = user_table[i];
+User* find_user_by_id(int id);
+
+User* user_alloc() {
+    if (!user_pages || user_pages->used == USER_PAGE_RECORDS) {
+        UserPage* pg = (UserPage*)arena_alloc(&user_arena, sizeof(UserPage), 8);
+        pg->used = 0;
+        pg->next = user_pages;
+        user_pages = pg;
+    }
+    return &user_pages->recs[user_pages->used++];
+}
+
+void password_digest(const char* username, const char* password, unsigned char out[DIGEST_LEN]) {
+    char buf[2 * MAX_NAME];
+    size_t ul = strlen(username), pl = strlen(password);
+    if (ul >= MAX_NAME) ul = MAX_NAME - 1;
+    if (pl >= MAX_NAME) pl = MAX_NAME - 1;
+    memcpy(buf, username, ul);
+    buf[ul] = '\0';
+    memcpy(buf + ul + 1, password, pl);
+    sha256(buf, ul + 1 + pl, out);
+}
+
+int user_check_password(const User* u, const char* password) {
+    unsigned char d[DIGEST_LEN];
+    unsigned char diff = 0;
+    password_digest(u->username, password, d);
+    for (int i = 0; i < DIGEST_LEN; ++i) diff |= d[i] ^ u->pw_digest[i];
+    return diff == 0;
+}
+
+/* Ids are dense: one far above the rest would size every per-user array
+   for it, so ids more than USER_ID_GAP_MAX past the highest are refused. */
+int user_id_plausible(int id) {
+    return id > 0 && id < MAX_USER_ID && id < next_user_id + USER_ID_GAP_MAX;
+}
+
+int user_id_available(int id) {
+    return user_id_plausible(id) && !find_user_by_id(id);
+}
+
+/* Presize for an expected number of users (bulk loads); only while idle. */
+void user_table_reserve(unsigned int expected) {
+    if (user_rehash_idx >= 0) return;
+    unsigned int size = user_table[0].size ? user_table[0].size : USER_TABLE_INITIAL;
+    while (size < expected) size <<= 1;
+    if (size == user_table[0].size) return;
+    user_table_init(&user_table[1], size);
+    user_rehash_idx = 0;
+    user_rehash_step((int)user_table[0].size + 1);
+}
+
+User* find_user_by_name(const char *username) {
+    unsigned int h = hash_username(username);
+    for (int t = 0; t < 2; ++t) {
+        if (!user_table[t].size) continue;
+        User* cur = user_table[t].buckets[h & (user_table[t].size - 1)];
         while (cur) {
-            if (cur->id == id) return cur;
+            if (strcmp(cur->username, username) == 0) return cur;
             cur = cur->next;
         }
+        if (user_rehash_idx < 0) break;
     }
     return NULL;
 }
 
-User* create_user(const char *username, const char *password, Role role) {
-    if (find_user_by_name(username)) return NULL;
-    User* u = (User*)malloc(sizeof(User));
-    strncpy(u->username, username, MAX_NAME-1); u->username[MAX_NAME-1]='\0';
-    strncpy(u->password, password, MAX_NAME-1); u->password[MAX_NAME-1]='\0';
-    u->role = role;
-    u->id = next_user_id++;
-    unsigned int h = hash_username(username);
-    u->next = user_table[h];
-    user_table[h] = u;
+User* find_user_by_id(int id) {
+    if (id <= 0 || id >= users_by_id_cap) return NULL;
+    return users_by_id[id];
+}
+
+/* Link a fully initialised user into the name table and the id index.
+   Returns 0 on success, -1 if the id is out of range or already taken. */
+int user_index_insert(User* u) {
+    if (!user_id_plausible(u->id)) return -1;
+    if (u->id >= users_by_id_cap) {
+        int newcap = users_by_id_cap ? users_by_id_cap : INITIAL_USER_CAP;
+        while (newcap <= u->id) newcap *= 2;
+        users_by_id = (User**)mem_realloc(MEM_USERS, users_by_id, (size_t)users_by_id_cap * sizeof(User*),
+                                          (size_t)newcap * sizeof(User*));
+        memset(users_by_id + users_by_id_cap, 0, (size_t)(newcap - users_by_id_cap) * sizeof(User*));
+        users_by_id_cap = newcap;
+    }
+    if (users_by_id[u->id]) return -1;
+    users_by_id[u->id] = u;
+
+    if (!user_table[0].size) user_table_init(&user_table[0], USER_TABLE_INITIAL);
+    user_rehash_step(USER_REHASH_STEP);
+    UserTable* t = user_rehash_idx >= 0 ? &user_table[1] : &user_table[0];
+    unsigned int h = hash_username(u->username) & (t->size - 1);
+    u->next = t->buckets[h];
+    t->buckets[h] = u;
+    t->used++;
     total_users++;
+    if (u->id >= next_user_id) next_user_id = u->id + 1;
+    if (user_rehash_idx < 0 && user_table[0].used >= user_table[0].size) {
+        user_table_init(&user_table[1], user_table[0].size * 2);
+        user_rehash_idx = 0;
+    }
+    return 0;
+}
+
+RadixTree user_names = RADIX_INIT(MEM_USERS); // username prefixes -> user id
+
+/* Add a user whose credentials are already digested (file load, replay). */
+User* insert_user_record(int id, const char* username, const unsigned char digest[DIGEST_LEN], Role role) {
+    if (!*username || strlen(username) >= MAX_NAME) return NULL;
+    if (!user_id_available(id) || find_user_by_name(username)) return NULL;
+    User* u = user_alloc();
+    u->username = arena_strdup(&user_arena, username);
+    memcpy(u->pw_digest, digest, DIGEST_LEN);
+    u->role = role;
+    u->id = id;
+    user_index_insert(u);
+    radix_insert(&user_names, u->username, u->id);
+    wal_log(WAL_USER, u->id, (int)u->role, u->username, u->pw_digest);
     return u;
 }
 
+User* create_user(const char *username, const char *password, Role role) {
+    unsigned char d[DIGEST_LEN];
+    password_digest(username, password, d);
+    return insert_user_record(next_user_id, username, d, role);
+}
+
+/* Drop every user at once; the users pool is empty afterwards. */
+void users_teardown(void) {
+    for (int t = 0; t < 2; ++t) mem_free(MEM_USERS, user_table[t].buckets, user_table[t].size * sizeof(User*));
+    memset(user_table, 0, sizeof(user_table));
+    user_rehash_idx = -1;
+    mem_free(MEM_USERS, users_by_id, (size_t)users_by_id_cap * sizeof(User*));
+    users_by_id = NULL;
+    users_by_id_cap = 0;
+    radix_reset(&user_names);
+    arena_free(&user_arena);
+    user_pages = NULL;
+    total_users = 0;
+    next_user_id = 1;
+}
+
 /* =========================
    Chat System - Graph (Adj list) + message queue per chat
+   chat_adj grows with user ids. Every directed edge (u,v) is also kept in an
+   open-addressing map keyed by the pair, so find_chatnode is O(1) no matter
+   how many peers a user has. Peer listings read a CSR snapshot (offsets +
+   packed peer ids and conversations) that is rebuilt lazily, on the first
+   listing after an edge is added.
+
+   Both directions of a pair share one append-only Conversation log.
+   Messages are length-prefixed records bump-allocated in segments that
+   grow from CONV_SEGMENT_MIN to CONV_SEGMENT_MAX; a seq -> record index
+   lets a page of history be read without walking older messages.
+
+   Sending does not touch the log. Each user has a Mailbox, an intrusive
+   multi-producer single-consumer queue (Vyukov): a sender links its
+   message in with one atomic exchange and never blocks, so thousands of
+   students messaging one teacher do not contend. Mailboxes are drained in
+   batches into the logs when a conversation is read, when a mailbox
+   passes MAILBOX_DRAIN_AT pending messages, and before a snapshot. A
+   global send sequence keeps the two directions of a pair in send order
+   even though they arrive through different mailboxes.
+
+   Messages are numbered by absolute seq, which survives eviction: index[i]
+   holds seq base + i. Each participant has a cursor (the first seq they
+   have not fetched) and a pair of counters (received, seen), so "what is
+   new" costs O(new) and unread counts cost O(1) per peer. At checkpoints,
+   when no command is in flight, the retention policy drops messages
+   beyond the newest chat_retain_messages or older than chat_retain_days
+   by rewriting the surviving tail of a log into a fresh arena.
    ========================= */
 
-typedef struct Message {
+typedef struct MsgRecord {
     int sender_id;
-    char text[MAX_TEXT];
-    time_t ts;
-    struct Message* next;
-} Message;
+    uint32_t len; // text length, excluding the terminator
+    int64_t ts;
+    char text[]; // len bytes + '\0'
+} MsgRecord;
+
+typedef struct Conversation {
+    int user_a, user_b; // user_a < user_b
+    Arena log;
+    MsgRecord** index; // index[seq] for seq in [0, count)
+    uint64_t* order;   // order[seq] = global send sequence of index[seq], 0 if loaded
+    uint32_t* docs;    // docs[seq] = search document of index[seq]
+    size_t count, cap;
+    uint64_t base;     // messages evicted so far; index[0] is absolute seq base
+    uint64_t next[2];  // per participant (0 = user_a, 1 = user_b): first seq not fetched
+    uint64_t recv[2];  // messages each participant has received
+    uint64_t seen[2];  // ... and of those, read
+    pthread_mutex_t lock; // guards everything above except user_a/user_b
+} Conversation;
+
+typedef struct MailNode {
+    struct MailNode* next;
+    Conversation* conv;
+    uint64_t order; // global send sequence
+    int64_t ts;
+    int sender_id;
+    uint32_t len;
+    char text[];
+} MailNode;
+
+typedef struct Mailbox {
+    MailNode* head; // most recently pushed; producers exchange here
+    MailNode* tail; // next to pop; consumer only
+    MailNode* stub;
+    long pending;   // pushed and not drained yet
+    pthread_mutex_t drain; // held by the single consumer
+} Mailbox;
+
+uint32_t search_index_message(const Conversation* c, const MsgRecord* m);
+void search_retarget(uint32_t doc, const MsgRecord* m);
 
 /* For each pair (u,v) we store a Chat node in adjacency list of u for v */
 typedef struct ChatNode {
     int peer_id;
-    Message* head; // linked list queue (new messages appended at tail)
-    Message* tail;
+    Conversation* conv; // shared with the (v,u) node
     struct ChatNode* next;
 } ChatNode;
 
-ChatNode* chat_adj[1000]; // indexed by user id up to some capacity
-int chat_capacity = 1000;
+typedef struct ChatEdgeSlot {
+    uint64_t key; // (u << 32) | v, 0 = empty (ids start at 1)
+    ChatNode* node;
+} ChatEdgeSlot;
+
+Arena chat_arena = ARENA_INIT(MEM_CHAT); // adjacency nodes, conversations, mailboxes
+ChatNode** chat_adj = NULL; // indexed by user id
+Mailbox** chat_mailbox = NULL; // indexed by user id, created with the user's first edge
+int chat_capacity = 0;
+uint64_t chat_send_seq = 0;
+long chat_retain_messages = CHAT_RETAIN_MESSAGES;
+long chat_retain_days = CHAT_RETAIN_DAYS;
+ChatEdgeSlot* chat_edges = NULL;
+size_t chat_edge_cap = 0; // power of two
+size_t chat_edge_count = 0;
+
+/* CSR snapshot of chat_adj: the peers of u are chat_csr_peers[chat_csr_off[u]
+   .. chat_csr_off[u+1]), newest first, with their conversations alongside in
+   chat_csr_convs. chat_link marks it dirty under chat_lock exclusive; the
+   rebuild runs under chat_csr_lock exclusive while chat_lock is shared. */
+int* chat_csr_off = NULL;
+int* chat_csr_peers = NULL;
+Conversation** chat_csr_convs = NULL;
+int chat_csr_users = 0;
+size_t chat_csr_cap = 0;
+int chat_csr_dirty = 1;
+pthread_rwlock_t chat_csr_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static uint64_t chat_edge_key(int u, int v) { return (uint64_t)(uint32_t)u << 32 | (uint32_t)v; }
+
+static size_t chat_edge_slot(uint64_t key, size_t cap) {
+    key ^= key >> 33; key *= 0xff51afd7ed558ccdULL; key ^= key >> 33;
+    return (size_t)key & (cap - 1);
+}
 
 ChatNode* find_chatnode(int user_id, int peer_id) {
-    if (user_id <=0 || user_id >= chat_capacity) return NULL;
-    ChatNode* cur = chat_adj[user_id];
-    while (cur) {
-        if (cur->peer_id == peer_id) return cur;
-        cur = cur->next;
-    }
+    if (user_id <= 0 || peer_id <= 0 || !chat_edge_cap) return NULL;
+    uint64_t key = chat_edge_key(user_id, peer_id);
+    for (size_t i = chat_edge_slot(key, chat_edge_cap); chat_edges[i].key; i = (i + 1) & (chat_edge_cap - 1))
+        if (chat_edges[i].key == key) return chat_edges[i].node;
     return NULL;
 }
 
+static void chat_edge_put(uint64_t key, ChatNode* cn) {
+    size_t i = chat_edge_slot(key, chat_edge_cap);
+    while (chat_edges[i].key) i = (i + 1) & (chat_edge_cap - 1);
+    chat_edges[i].key = key;
+    chat_edges[i].node = cn;
+}
+
+static void chat_edge_reserve(size_t want) {
+    if (want * 10 < chat_edge_cap * 7) return; // keep load below 0.7
+    size_t oldcap = chat_edge_cap;
+    ChatEdgeSlot* old = chat_edges;
+    chat_edge_cap = oldcap ? oldcap * 2 : 1024;
+    while (want * 10 >= chat_edge_cap * 7) chat_edge_cap *= 2;
+    chat_edges = (ChatEdgeSlot*)mem_calloc(MEM_CHAT, chat_edge_cap * sizeof(ChatEdgeSlot));
+    for (size_t i = 0; i < oldcap; ++i)
+        if (old[i].key) chat_edge_put(old[i].key, old[i].node);
+    mem_free(MEM_CHAT, old, oldcap * sizeof(ChatEdgeSlot));
+}
+
 void ensure_chat_capacity(int id) {
-    if (id >= chat_capacity) {
-        int newcap = chat_capacity * 2;
-        while (newcap <= id) newcap *= 2;
-        chat_adj[newcap-1] = NULL; // just to resize array trick not allowed in C easily
-        // Simpler: we won't reallocate; assume capacity >= many users (set large)
+    if (id < chat_capacity) return;
+    int newcap = chat_capacity ? chat_capacity : INITIAL_USER_CAP;
+    while (newcap <= id) newcap *= 2;
+    chat_adj = (ChatNode**)mem_realloc(MEM_CHAT, chat_adj, (size_t)chat_capacity * sizeof(ChatNode*),
+                                       (size_t)newcap * sizeof(ChatNode*));
+    memset(chat_adj + chat_capacity, 0, (size_t)(newcap - chat_capacity) * sizeof(ChatNode*));
+    chat_mailbox = (Mailbox**)mem_realloc(MEM_CHAT, chat_mailbox, (size_t)chat_capacity * sizeof(Mailbox*),
+                                          (size_t)newcap * sizeof(Mailbox*));
+    memset(chat_mailbox + chat_capacity, 0, (size_t)(newcap - chat_capacity) * sizeof(Mailbox*));
+    chat_capacity = newcap;
+}
+
+static Mailbox* mailbox_new(void) {
+    Mailbox* mb = (Mailbox*)arena_alloc(&chat_arena, sizeof(Mailbox), 8);
+    memset(mb, 0, sizeof(*mb));
+    mb->stub = (MailNode*)arena_alloc(&chat_arena, sizeof(MailNode), 8);
+    memset(mb->stub, 0, sizeof(*mb->stub));
+    mb->head = mb->tail = mb->stub;
+    pthread_mutex_init(&mb->drain, NULL);
+    return mb;
+}
+
+static void mailbox_push(Mailbox* mb, MailNode* n) {
+    __atomic_store_n(&n->next, NULL, __ATOMIC_RELAXED);
+    MailNode* prev = __atomic_exchange_n(&mb->head, n, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, n, __ATOMIC_RELEASE); // until here n is unreachable to the consumer
+}
+
+/* Consumer side; caller holds mb->drain. Returns NULL when empty or when a
+   push is half done, in which case the next drain picks it up. A popped
+   node already has a successor, so no producer can still write to it. */
+static MailNode* mailbox_pop(Mailbox* mb) {
+    MailNode* tail = mb->tail;
+    MailNode* next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (tail == mb->stub) {
+        if (!next) return NULL;
+        mb->tail = tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
     }
+    if (next) { mb->tail = next; return tail; }
+    if (tail != __atomic_load_n(&mb->head, __ATOMIC_ACQUIRE)) return NULL;
+    mailbox_push(mb, mb->stub); // tail is the last node: put the stub behind it
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next) { mb->tail = next; return tail; }
+    return NULL;
+}
+
+static ChatNode* chat_link(int u, int v, Conversation* conv) {
+    ChatNode* cn = (ChatNode*)arena_alloc(&chat_arena, sizeof(ChatNode), 8);
+    cn->peer_id = v; cn->conv = conv; cn->next = chat_adj[u];
+    chat_adj[u] = cn;
+    chat_edge_reserve(chat_edge_count + 1);
+    chat_edge_put(chat_edge_key(u, v), cn);
+    chat_edge_count++;
+    chat_csr_dirty = 1;
+    return cn;
 }
 
 void add_chat_edge(int u, int v) {
     if (u<=0||v<=0) return;
-    if (!find_chatnode(u,v)) {
-        ChatNode* cn = (ChatNode*)malloc(sizeof(ChatNode));
-        cn->peer_id = v; cn->head = cn->tail = NULL; cn->next = chat_adj[u];
-        chat_adj[u] = cn;
+    ensure_chat_capacity(u > v ? u : v);
+    if (find_chatnode(u,v)) return; // edges are always created in pairs
+    Conversation* conv = (Conversation*)arena_alloc(&chat_arena, sizeof(Conversation), 8);
+    memset(conv, 0, sizeof(*conv));
+    conv->log.pool = MEM_MESSAGES;
+    pthread_mutex_init(&conv->lock, NULL);
+    conv->user_a = u < v ? u : v;
+    conv->user_b = u < v ? v : u;
+    chat_link(u, v, conv);
+    if (u != v) chat_link(v, u, conv); // a note-to-self conversation has one node
+    if (!chat_mailbox[u]) chat_mailbox[u] = mailbox_new();
+    if (!chat_mailbox[v]) chat_mailbox[v] = mailbox_new();
+}
+
+static void chat_csr_build(void) {
+    size_t edges = chat_edge_count ? chat_edge_count : 1;
+    chat_csr_off = (int*)mem_realloc(MEM_CHAT, chat_csr_off, chat_csr_off ? (size_t)(chat_csr_users + 1) * sizeof(int) : 0,
+                                     (size_t)(chat_capacity + 1) * sizeof(int));
+    if (edges > chat_csr_cap) {
+        chat_csr_peers = (int*)mem_realloc(MEM_CHAT, chat_csr_peers, chat_csr_cap * sizeof(int), edges * sizeof(int));
+        chat_csr_convs = (Conversation**)mem_realloc(MEM_CHAT, chat_csr_convs, chat_csr_cap * sizeof(Conversation*),
+                                                     edges * sizeof(Conversation*));
+        chat_csr_cap = edges;
     }
-    if (!find_chatnode(v,u)) {
-        ChatNode* cn = (ChatNode*)malloc(sizeof(ChatNode));
-        cn->peer_id = u; cn->head = cn->tail = NULL; cn->next = chat_adj[v];
-        chat_adj[v] = cn;
+    chat_csr_users = chat_capacity;
+    int k = 0;
+    for (int u = 0; u < chat_csr_users; ++u) {
+        chat_csr_off[u] = k;
+        for (ChatNode* cn = chat_adj[u]; cn; cn = cn->next) { chat_csr_peers[k] = cn->peer_id; chat_csr_convs[k++] = cn->conv; }
     }
+    chat_csr_off[chat_csr_users] = k;
+    chat_csr_dirty = 0;
 }
 
-void send_message(int from_id, int to_id, const char *text) {
-    add_chat_edge(from_id, to_id);
-    ChatNode* cn = find_chatnode(to_id, from_id); // store in recipient's node so they can read
-    if (!cn) return;
-    Message* m = (Message*)malloc(sizeof(Message));
-    m->sender_id = from_id;
-    strncpy(m->text, text, MAX_TEXT-1); m->text[MAX_TEXT-1] = '\0';
-    m->ts = time(NULL);
-    m->next = NULL;
-    if (!cn->head) cn->head = cn->tail = m;
-    else { cn->tail->next = m; cn->tail = m; }
-}
-
-void view_messages_between(int viewer_id, int peer_id) {
-    ChatNode* cn = find_chatnode(viewer_id, peer_id);
-    if (!cn || !cn->head) {
-        printf("No messages between you and user id %d.\n", peer_id);
-        return;
-    }
-    Message* cur = cn->head;
-    char timestr[64];
-    while (cur) {
-        struct tm *tm = localtime(&cur->ts);
-        strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", tm);
-        User* sender = find_user_by_id(cur->sender_id);
-        printf("[%s] %s: %s\n", timestr, sender ? sender->username : "Unknown", cur->text);
-        cur = cur->next;
+/* Take chat_csr_lock shared with the snapshot up to date; release it with
+   pthread_rwlock_unlock. The caller holds chat_lock shared, so the graph
+   cannot change until it is done. */
+static void chat_csr_acquire(void) {
+    pthread_rwlock_rdlock(&chat_csr_lock);
+    while (chat_csr_dirty) {
+        pthread_rwlock_unlock(&chat_csr_lock);
+        pthread_rwlock_wrlock(&chat_csr_lock);
+        if (chat_csr_dirty) chat_csr_build();
+        pthread_rwlock_unlock(&chat_csr_lock);
+        pthread_rwlock_rdlock(&chat_csr_lock);
     }
 }
 
-/* =========================
-   Announcements - Stack
-   ========================= */
+/* Peers of user_id in the snapshot: returns how many, starting at *first. */
+static int chat_peers(int user_id, int* first) {
+    if (user_id <= 0 || user_id >= chat_csr_users) { *first = 0; return 0; }
+    *first = chat_csr_off[user_id];
+    return chat_csr_off[user_id + 1] - *first;
+}
 
-typedef struct Announcement {
-    char text[MAX_TEXT];
-    time_t ts;
-    struct Announcement* next;
-} Announcement;
+Conversation* find_conversation(int u, int v) {
+    ChatNode* cn = find_chatnode(u, v);
+    return cn ? cn->conv : NULL;
+}
 
-Announcement* ann_stack = NULL;
+static int conv_side(const Conversation* c, int user_id) { return user_id == c->user_a ? 0 : 1; }
 
-void push_announcement(const char *text) {
-    Announcement* a = (Announcement*)malloc(sizeof(Announcement));
-    strncpy(a->text, text, MAX_TEXT-1); a->text[MAX_TEXT-1] = '\0';
-    a->ts = time(NULL);
-    a->next = ann_stack;
-    ann_stack = a;
+/* Add a record to c->index at its place in send order and return its
+   position. Records almost always arrive in order, so this is an append in
+   practice; a late one moves back cursors that already passed its place,
+   so it is fetched (with the few after it) once more rather than never. */
+static size_t conv_index_insert(Conversation* c, MsgRecord* m, uint64_t order) {
+    if (c->count == c->cap) {
+        size_t old = c->cap;
+        c->cap = c->cap ? c->cap * 2 : 8;
+        c->index = (MsgRecord**)mem_realloc(MEM_CHAT, c->index, old * sizeof(MsgRecord*), c->cap * sizeof(MsgRecord*));
+        c->order = (uint64_t*)mem_realloc(MEM_CHAT, c->order, old * sizeof(uint64_t), c->cap * sizeof(uint64_t));
+        c->docs = (uint32_t*)mem_realloc(MEM_CHAT, c->docs, old * sizeof(uint32_t), c->cap * sizeof(uint32_t));
+    }
+    size_t i = c->count++;
+    for (; i > 0 && c->order[i-1] > order; --i) {
+        c->index[i] = c->index[i-1];
+        c->order[i] = c->order[i-1];
+        c->docs[i] = c->docs[i-1];
+    }
+    c->index[i] = m;
+    c->order[i] = order;
+    c->docs[i] = 0;
+    for (int k = 0; k < 2 && i + 1 < c->count; ++k)
+        if (c->next[k] > c->base + i) c->next[k] = c->base + i;
+    return i;
 }
 
-void view_announcements() {
-    if (!ann_stack) { printf("No announcements.\n"); return; }
-    Announcement* cur = ann_stack;
-    char timestr[64];
-    while (cur) {
-        struct tm *tm = localtime(&cur->ts);
-        strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", tm);
-        printf("[%s] %s\n", timestr, cur->text);
-        cur = cur->next;
+static size_t conv_store(Conversation* c, int sender_id, int64_t ts, const char* text, size_t len, uint64_t order) {
+    if (len > MAX_TEXT-1) len = MAX_TEXT-1;
+    size_t need = sizeof(MsgRecord) + len + 1;
+    ArenaBlock* b = c->log.head;
+    if (!b || ((b->used + 7) & ~(size_t)7) + need > b->cap) {
+        size_t seg = b ? b->cap * 2 : CONV_SEGMENT_MIN;
+        c->log.block_size = seg > CONV_SEGMENT_MAX ? CONV_SEGMENT_MAX : seg;
     }
+    MsgRecord* m = (MsgRecord*)arena_alloc(&c->log, need, 8);
+    m->sender_id = sender_id;
+    m->len = (uint32_t)len;
+    m->ts = ts;
+    memcpy(m->text, text, len);
+    m->text[len] = '\0';
+    int from = conv_side(c, sender_id);
+    c->recv[!from]++;
+    size_t seq = conv_index_insert(c, m, order);
+    if (c->next[from] == c->base + seq) c->next[from]++; // a sender who is caught up stays so
+    return seq;
 }
 
-/* =========================
-   Syllabus - BST per subject
-   ========================= */
-
-typedef struct Topic {
-    char name[128];
-    int completed; // 0/1
-    struct Topic *left, *right;
-} Topic;
+/* Move everything in mb into the conversation logs; caller holds mb->drain.
+   Consecutive messages for the same conversation share one lock hold. */
+static void mailbox_drain_locked(Mailbox* mb) {
+    Conversation* held = NULL;
+    long drained = 0;
+    MailNode* n;
+    while ((n = mailbox_pop(mb)) != NULL) {
+        if (n->conv != held) {
+            if (held) pthread_mutex_unlock(&held->lock);
+            held = n->conv;
+            pthread_mutex_lock(&held->lock);
+        }
+        size_t seq = conv_store(held, n->sender_id, n->ts, n->text, n->len, n->order);
+        held->docs[seq] = search_index_message(held, held->index[seq]);
+        mem_free(MEM_MAILBOXES, n, sizeof(MailNode) + n->len + 1);
+        drained++;
+    }
+    if (held) pthread_mutex_unlock(&held->lock);
+    if (drained) __atomic_sub_fetch(&mb->pending, drained, __ATOMIC_RELAXED);
+}
 
-typedef struct Subject {
-    char name[MAX_SUBJECT_NAME];
-    Topic* root;
-    struct Subject* next;
-} Subject;
+/* Caller holds chat_lock (shared is enough). */
+void mailbox_drain(int user_id) {
+    if (user_id <= 0 || user_id >= chat_capacity || !chat_mailbox[user_id]) return;
+    Mailbox* mb = chat_mailbox[user_id];
+    pthread_mutex_lock(&mb->drain);
+    mailbox_drain_locked(mb);
+    pthread_mutex_unlock(&mb->drain);
+}
 
-Subject* subjects = NULL;
+void chat_drain_all(void) {
+    for (int u = 0; u < chat_capacity; ++u) mailbox_drain(u);
+}
 
-Topic* create_topic_node(const char *name) {
-    Topic* t = (Topic*)malloc(sizeof(Topic));
-    strncpy(t->name, name, sizeof(t->name)-1); t->name[sizeof(t->name)-1] = '\0';
-    t->completed = 0; t->left = t->right = NULL;
-    return t;
+/* Page of up to limit messages older than absolute seq `before` (-1 =
+   newest). Returns how many were stored in out (oldest first) and sets
+   *older to the seq of out[0], the cursor for the next older page, or to
+   -1 when nothing older is retained. */
+int conv_page(const Conversation* c, long before, int limit, const MsgRecord** out, long* older) {
+    long base = (long)c->base, end = base + (long)c->count;
+    if (before >= 0 && before < end) end = before;
+    long start = end - limit;
+    if (start < base) start = base;
+    for (long i = start; i < end; ++i) out[i - start] = c->index[i - base];
+    *older = start > base && start < end ? start : -1;
+    return start < end ? (int)(end - start) : 0;
 }
 
-Topic* bst_insert(Topic* root, const char* name) {
-    if (!root) return create_topic_node(name);
-    int cmp = strcmp(name, root->name);
-    if (cmp < 0) root->left = bst_insert(root->left, name);
-    else if (cmp > 0) root->right = bst_insert(root->right, name);
-    else { /* duplicate; ignore */ }
-    return root;
+/* Conversation for the pair, created on first use. Returns with chat_lock
+   held shared; conversations are never freed, so the pointer stays valid
+   after the lock is dropped. */
+static Conversation* chat_open(int u, int v) {
+    pthread_rwlock_rdlock(&chat_lock);
+    Conversation* c = find_conversation(u, v);
+    if (c) return c;
+    pthread_rwlock_unlock(&chat_lock);
+    pthread_rwlock_wrlock(&chat_lock);
+    add_chat_edge(u, v);
+    pthread_rwlock_unlock(&chat_lock);
+    pthread_rwlock_rdlock(&chat_lock);
+    return find_conversation(u, v);
 }
 
-Subject* find_subject(const char* name) {
-    Subject* cur = subjects;
-    while (cur) {
-        if (strcmp(cur->name, name) == 0) return cur;
-        cur = cur->next;
+void send_message_at(int from_id, int to_id, const char *text, int64_t ts) {
+    Conversation* c = chat_open(from_id, to_id);
+    if (c) {
+        size_t len = strlen(text);
+        if (len > MAX_TEXT-1) len = MAX_TEXT-1;
+        MailNode* n = (MailNode*)mem_alloc(MEM_MAILBOXES, sizeof(MailNode) + len + 1);
+        n->conv = c;
+        n->order = __atomic_add_fetch(&chat_send_seq, 1, __ATOMIC_RELAXED);
+        n->ts = ts;
+        n->sender_id = from_id;
+        n->len = (uint32_t)len;
+        memcpy(n->text, text, len);
+        n->text[len] = '\0';
+        wal_log(WAL_MESSAGE, from_id, to_id, ts, n->text);
+        Mailbox* mb = chat_mailbox[to_id];
+        mailbox_push(mb, n);
+        // a recipient who never reads should not pile up nodes: the sender that
+        // crosses the mark drains, unless someone else already is
+        if (__atomic_add_fetch(&mb->pending, 1, __ATOMIC_RELAXED) >= MAILBOX_DRAIN_AT
+            && pthread_mutex_trylock(&mb->drain) == 0) {
+            mailbox_drain_locked(mb);
+            pthread_mutex_unlock(&mb->drain);
+        }
+    }
+    pthread_rwlock_unlock(&chat_lock);
+}
+
+/* conv_page under the chat locks; the newest page also marks the whole
+   conversation read for the viewer. Records are immutable once appended
+   and only move during a checkpoint, when no command runs, so out stays
+   readable until the calling command ends. */
+int chat_read_page(int viewer_id, int peer_id, long before, int limit, const MsgRecord** out, long* older) {
+    pthread_rwlock_rdlock(&chat_lock);
+    Conversation* c = find_conversation(viewer_id, peer_id);
+    int n = 0;
+    *older = -1;
+    if (c) {
+        mailbox_drain(viewer_id); // messages from peer
+        mailbox_drain(peer_id);   // messages from viewer
+        pthread_mutex_lock(&c->lock);
+        n = conv_page(c, before, limit, out, older);
+        if (before < 0) {
+            int k = conv_side(c, viewer_id);
+            c->next[k] = c->base + c->count;
+            c->seen[k] = c->recv[k];
+        }
+        pthread_mutex_unlock(&c->lock);
+    }
+    pthread_rwlock_unlock(&chat_lock);
+    return n;
+}
+
+/* Up to limit messages the viewer has not fetched yet, oldest first, and
+   moves the viewer's cursor past them: O(new), whatever the history.
+   *unread is set to what remains unread afterwards. */
+int chat_read_new(int viewer_id, int peer_id, int limit, const MsgRecord** out, long* unread) {
+    pthread_rwlock_rdlock(&chat_lock);
+    Conversation* c = find_conversation(viewer_id, peer_id);
+    int n = 0;
+    *unread = 0;
+    if (c) {
+        mailbox_drain(viewer_id);
+        mailbox_drain(peer_id);
+        pthread_mutex_lock(&c->lock);
+        int k = conv_side(c, viewer_id);
+        uint64_t seq = c->next[k] < c->base ? c->base : c->next[k], end = c->base + c->count;
+        for (; seq < end && n < limit; ++seq) {
+            const MsgRecord* m = c->index[seq - c->base];
+            out[n++] = m;
+            if (m->sender_id != viewer_id && c->seen[k] < c->recv[k]) c->seen[k]++;
+        }
+        c->next[k] = seq;
+        if (seq == end) c->seen[k] = c->recv[k];
+        *unread = (long)(c->recv[k] - c->seen[k]);
+        pthread_mutex_unlock(&c->lock);
+    }
+    pthread_rwlock_unlock(&chat_lock);
+    return n;
+}
+
+typedef struct ChatUnread {
+    int peer_id;
+    long unread;
+} ChatUnread;
+
+/* Every peer of viewer_id with the number of messages from them the viewer
+   has not read, from the counters. Returns the count; *out is malloc'd. */
+int chat_unread_counts(int viewer_id, ChatUnread** out) {
+    int n = 0;
+    *out = NULL;
+    pthread_rwlock_rdlock(&chat_lock);
+    if (viewer_id > 0 && viewer_id < chat_capacity) {
+        mailbox_drain(viewer_id); // everything sent to the viewer is in here
+        chat_csr_acquire();
+        int first, peers = chat_peers(viewer_id, &first);
+        if (peers) *out = (ChatUnread*)malloc((size_t)peers * sizeof(ChatUnread));
+        for (; n < peers; ++n) {
+            Conversation* c = chat_csr_convs[first + n];
+            int k = conv_side(c, viewer_id);
+            pthread_mutex_lock(&c->lock);
+            (*out)[n].peer_id = chat_csr_peers[first + n];
+            (*out)[n].unread = (long)(c->recv[k] - c->seen[k]);
+            pthread_mutex_unlock(&c->lock);
+        }
+        pthread_rwlock_unlock(&chat_csr_lock);
+    }
+    pthread_rwlock_unlock(&chat_lock);
+    return n;
+}
+
+void send_message(int from_id, int to_id, const char *text) {
+    send_message_at(from_id, to_id, text, (int64_t)time(NULL));
+}
+
+void print_messages(const MsgRecord** msgs, int n) {
+    char timestr[64];
+    for (int i = 0; i < n; ++i) {
+        time_t ts = (time_t)msgs[i]->ts;
+        struct tm *tm = localtime(&ts);
+        strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", tm);
+        User* sender = find_user_by_id(msgs[i]->sender_id);
+        printf("[%s] %s: %s\n", timestr, sender ? sender->username : "Unknown", msgs[i]->text);
+    }
+}
+
+/* Print one page of the conversation; returns the cursor for the next
+   older page, or -1 when nothing older remains. */
+long view_messages_between(int viewer_id, int peer_id, long before, int limit) {
+    const MsgRecord* page[MSG_PAGE_SIZE];
+    if (limit > MSG_PAGE_SIZE) limit = MSG_PAGE_SIZE;
+    long older = -1;
+    int n = chat_read_page(viewer_id, peer_id, before, limit, page, &older);
+    if (!n) {
+        printf("No messages between you and user id %d.\n", peer_id);
+        return -1;
+    }
+    print_messages(page, n);
+    return older;
+}
+
+/* Print the messages the viewer has not seen yet, a page at a time.
+   Returns how many were printed. */
+long view_new_messages(int viewer_id, int peer_id) {
+    const MsgRecord* page[MSG_PAGE_SIZE];
+    long total = 0, unread = 0;
+    int n;
+    while ((n = chat_read_new(viewer_id, peer_id, MSG_PAGE_SIZE, page, &unread)) > 0) {
+        print_messages(page, n);
+        total += n;
+    }
+    return total;
+}
+
+/* Rewrite c's log without its oldest k messages: survivors are copied into
+   one fresh block and the old segments freed. Cursors and unread counters
+   follow; search documents of dropped messages are retired and those of
+   survivors pointed at the copies. Only runs when no command is in flight. */
+static void conv_evict(Conversation* c, size_t k) {
+    size_t bytes = 0;
+    for (size_t i = k; i < c->count; ++i) bytes += (sizeof(MsgRecord) + c->index[i]->len + 1 + 7) & ~(size_t)7;
+    for (size_t i = 0; i < k; ++i) search_retarget(c->docs[i], NULL);
+    Arena log = ARENA_INIT(MEM_MESSAGES);
+    log.block_size = bytes > CONV_SEGMENT_MIN ? bytes : CONV_SEGMENT_MIN;
+    uint64_t keep_unread[2] = { 0, 0 };
+    for (size_t i = k; i < c->count; ++i) {
+        const MsgRecord* old = c->index[i];
+        size_t n = sizeof(MsgRecord) + old->len + 1;
+        MsgRecord* m = (MsgRecord*)arena_alloc(&log, n, 8);
+        memcpy(m, old, n);
+        c->index[i - k] = m;
+        c->order[i - k] = c->order[i];
+        c->docs[i - k] = c->docs[i];
+        search_retarget(c->docs[i - k], m);
+        int to = !conv_side(c, m->sender_id);
+        if (c->base + i >= c->next[to]) keep_unread[to]++; // not fetched yet
+    }
+    arena_free(&c->log);
+    c->log = log;
+    c->count -= k;
+    c->base += k;
+    for (int s = 0; s < 2; ++s) {
+        if (c->next[s] < c->base) c->next[s] = c->base;
+        if (c->recv[s] - c->seen[s] > keep_unread[s]) c->seen[s] = c->recv[s] - keep_unread[s];
+    }
+}
+
+/* Apply the retention policy to every conversation. A log is rewritten
+   only once an eighth of it (or all of it) has expired, so each message is
+   copied O(1) times. Called by checkpoint(). Returns messages dropped. */
+long chat_compact(int64_t now) {
+    if (chat_retain_messages <= 0 && chat_retain_days <= 0) return 0;
+    int64_t cutoff = chat_retain_days > 0 ? now - (int64_t)chat_retain_days * 86400 : INT64_MIN;
+    long dropped = 0;
+    for (int u = 1; u < chat_capacity; ++u) {
+        for (ChatNode* cn = chat_adj[u]; cn; cn = cn->next) {
+            if (cn->peer_id < u) continue; // each pair once
+            Conversation* c = cn->conv;
+            size_t k = chat_retain_messages > 0 && c->count > (size_t)chat_retain_messages
+                     ? c->count - (size_t)chat_retain_messages : 0;
+            while (k < c->count && c->index[k]->ts < cutoff) ++k;
+            if (!k || (k < c->count && k < c->count / 8)) continue;
+            conv_evict(c, k);
+            dropped += (long)k;
+        }
+    }
+    return dropped;
+}
+
+/* Drop the whole chat graph: logs, indexes, undelivered mail and the
+   arrays. Only runs when nothing else is. */
+void chat_teardown(void) {
+    for (int u = 1; u < chat_capacity; ++u) {
+        for (ChatNode* cn = chat_adj[u]; cn; cn = cn->next) {
+            if (cn->peer_id < u) continue;
+            Conversation* c = cn->conv;
+            arena_free(&c->log);
+            mem_free(MEM_CHAT, c->index, c->cap * sizeof(MsgRecord*));
+            mem_free(MEM_CHAT, c->order, c->cap * sizeof(uint64_t));
+            mem_free(MEM_CHAT, c->docs, c->cap * sizeof(uint32_t));
+            pthread_mutex_destroy(&c->lock);
+        }
+        Mailbox* mb = chat_mailbox[u];
+        if (!mb) continue;
+        for (MailNode* n; (n = mailbox_pop(mb)) != NULL; ) mem_free(MEM_MAILBOXES, n, sizeof(MailNode) + n->len + 1);
+        pthread_mutex_destroy(&mb->drain);
+    }
+    mem_free(MEM_CHAT, chat_adj, (size_t)chat_capacity * sizeof(ChatNode*));
+    mem_free(MEM_CHAT, chat_mailbox, (size_t)chat_capacity * sizeof(Mailbox*));
+    mem_free(MEM_CHAT, chat_edges, chat_edge_cap * sizeof(ChatEdgeSlot));
+    mem_free(MEM_CHAT, chat_csr_off, (size_t)(chat_csr_users + 1) * sizeof(int));
+    mem_free(MEM_CHAT, chat_csr_peers, chat_csr_cap * sizeof(int));
+    mem_free(MEM_CHAT, chat_csr_convs, chat_csr_cap * sizeof(Conversation*));
+    arena_free(&chat_arena);
+    chat_adj = NULL; chat_mailbox = NULL; chat_capacity = 0;
+    chat_edges = NULL; chat_edge_cap = chat_edge_count = 0;
+    chat_csr_off = chat_csr_peers = NULL; chat_csr_convs = NULL;
+    chat_csr_users = 0; chat_csr_cap = 0; chat_csr_dirty = 1;
+    chat_send_seq = 0;
+}
+
+/* =========================
+   Announcements - Ring buffer feed
+   The newest ANN_RETENTION announcements are kept in a fixed ring; older
+   ones fall off as new ones are posted. Every entry has a sequence number
+   and its timestamp formatted once at post time, so "newest N", "since
+   cursor" and "since date" only touch the entries they print.
+   ========================= */
+
+typedef struct Announcement {
+    uint64_t seq; // 1-based, increases by one per post
+    int64_t ts;
+    char when[20]; // ts formatted as "%Y-%m-%d %H:%M:%S"
+    char text[MAX_TEXT];
+} Announcement;
+
+Announcement ann_ring[ANN_RETENTION];
+uint64_t ann_next_seq = 1;
+uint64_t* ann_seen = NULL; // ann_seen[user id] = last seq that user has viewed
+int ann_seen_cap = 0;
+
+void search_index_announcement(const Announcement* a);
+
+static uint64_t ann_oldest_seq(void) {
+    return ann_next_seq > ANN_RETENTION ? ann_next_seq - ANN_RETENTION : 1;
+}
+
+static Announcement* ann_at(uint64_t seq) {
+    return &ann_ring[seq & (ANN_RETENTION - 1)];
+}
+
+void push_announcement_at(const char *text, int64_t ts) {
+    Announcement* a = ann_at(ann_next_seq);
+    a->seq = ann_next_seq++;
+    a->ts = ts;
+    strncpy(a->text, text, MAX_TEXT-1); a->text[MAX_TEXT-1] = '\0';
+    time_t t = (time_t)ts;
+    struct tm tm;
+    if (!localtime_r(&t, &tm) || !strftime(a->when, sizeof(a->when), "%Y-%m-%d %H:%M:%S", &tm))
+        strcpy(a->when, "unknown time");
+    search_index_announcement(a);
+    wal_log(WAL_ANNOUNCE, ts, a->text);
+}
+
+void push_announcement(const char *text) {
+    push_announcement_at(text, (int64_t)time(NULL));
+}
+
+/* First retained seq whose timestamp is >= ts. Entries are in post order,
+   which is time order unless the clock was stepped back. */
+uint64_t ann_seq_since_time(int64_t ts) {
+    uint64_t lo = ann_oldest_seq(), hi = ann_next_seq;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (ann_at(mid)->ts < ts) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* Print retained announcements with seq in [from, ann_next_seq), newest
+   first, at most limit of them (limit <= 0 = all). Returns how many. */
+int print_announcements_from(uint64_t from, int limit) {
+    if (from < ann_oldest_seq()) from = ann_oldest_seq();
+    int n = 0;
+    for (uint64_t seq = ann_next_seq; seq-- > from && (limit <= 0 || n < limit); ++n) {
+        const Announcement* a = ann_at(seq);
+        printf("[%s] %s\n", a->when, a->text);
+    }
+    return n;
+}
+
+static uint64_t* ann_seen_slot(int user_id) {
+    if (user_id <= 0 || user_id >= next_user_id) return NULL;
+    if (user_id >= ann_seen_cap) {
+        int newcap = ann_seen_cap ? ann_seen_cap : INITIAL_USER_CAP;
+        while (newcap <= user_id) newcap *= 2;
+        ann_seen = (uint64_t*)mem_realloc(MEM_ANNOUNCEMENTS, ann_seen, (size_t)ann_seen_cap * sizeof(uint64_t),
+                                          (size_t)newcap * sizeof(uint64_t));
+        memset(ann_seen + ann_seen_cap, 0, (size_t)(newcap - ann_seen_cap) * sizeof(uint64_t));
+        ann_seen_cap = newcap;
+    }
+    return &ann_seen[user_id];
+}
+
+/* Newest page of the feed; also marks everything as seen for the viewer. */
+void view_announcements(int viewer_id) {
+    if (ann_next_seq == 1) { printf("No announcements.\n"); return; }
+    print_announcements_from(ann_oldest_seq(), ANN_PAGE_SIZE);
+    uint64_t* seen = ann_seen_slot(viewer_id);
+    if (seen) *seen = ann_next_seq - 1;
+}
+
+/* Only what was posted since the viewer last looked. */
+void view_new_announcements(int viewer_id) {
+    uint64_t* seen = ann_seen_slot(viewer_id);
+    uint64_t from = seen ? *seen + 1 : ann_oldest_seq();
+    if (from < ann_oldest_seq())
+        printf("(%llu older announcements have expired)\n", (unsigned long long)(ann_oldest_seq() - from));
+    if (!print_announcements_from(from, 0)) printf("No new announcements.\n");
+    if (seen) *seen = ann_next_seq - 1;
+}
+
+/* Empty the feed and forget every reader's position; the ring itself is static. */
+void ann_teardown(void) {
+    mem_free(MEM_ANNOUNCEMENTS, ann_seen, (size_t)ann_seen_cap * sizeof(uint64_t));
+    ann_seen = NULL;
+    ann_seen_cap = 0;
+    ann_next_seq = 1;
+}
+
+/* =========================
+   Search - inverted index over messages and announcements
+   Text is split into lowercase words (alphanumeric runs). Every indexed
+   message or announcement is a document with a dense id, handed out in
+   index order, and every word keeps one postings list: for each document
+   containing it, the doc id gap, the number of occurrences and their word
+   positions as gaps, all as LEB128 varints appended to one byte buffer.
+   Gaps are small, so a typical entry is two or three bytes.
+
+   Every SEARCH_SKIP_EVERY entries a list also records a skip entry (the
+   entry's doc id and byte offset), so a list can seek to a doc id by
+   binary search over its skips and then decode at most one block.
+
+   A query is a list of words that must all occur; a "quoted" run of words
+   must also occur as a phrase. Lists are intersected in step, driven by
+   the rarest word: the other lists seek to each candidate instead of being
+   decoded in full, so a query costs the rarest list plus one skip search
+   and at most a block per other list for each candidate. Phrases are
+   checked on the positions of the documents that survive. Visibility
+   (only conversations the viewer is part of, plus all announcements),
+   sender and time range are checked per match.
+
+   Messages are indexed as they are drained into their conversation log,
+   so a search first drains the viewer's mailbox and those of their peers.
+   Announcements are indexed when posted. Messages dropped by chat
+   retention and announcements that fell out of the feed are skipped by
+   queries, and search_compact removes their entries from the lists at a
+   checkpoint once they make up a quarter of all documents. Their doc ids
+   are not reused, since conversations refer to them.
+   ========================= */
+
+typedef struct SearchDoc {
+    const MsgRecord* msg; // NULL for an announcement or an evicted message
+    const Conversation* conv;
+    uint64_t ann_seq;
+    int64_t ts;
+} SearchDoc;
+
+typedef struct PostingSkip {
+    uint32_t doc;    // doc id of entry k * SEARCH_SKIP_EVERY
+    uint32_t offset; // where that entry starts in data
+} PostingSkip;
+
+typedef struct Posting {
+    char term[SEARCH_TERM_MAX];
+    uint8_t* data; // (doc gap, count, position gaps...) per document, varints
+    size_t len, cap;
+    uint32_t last_doc; // doc id of the last entry, base for the next gap
+    uint32_t df;       // documents in the list
+    PostingSkip* skips;
+    uint32_t nskip, skip_cap;
+} Posting;
+
+typedef struct SearchToken {
+    const char* term;
+    int pos;
+} SearchToken;
+
+typedef struct SearchHit {
+    int64_t ts;
+    const char* sender; // "" for announcements
+    const char* peer;   // other participant of a message, "" for announcements
+    char text[MAX_TEXT];
+} SearchHit;
+
+SearchDoc* search_docs = NULL; // search_docs[doc]; doc ids start at 1
+uint32_t search_doc_count = 0, search_doc_cap = 0;
+Posting* search_terms = NULL;
+uint32_t search_term_count = 0, search_term_cap = 0;
+uint32_t* search_term_slots = NULL; // open addressing: term index + 1, 0 = empty
+size_t search_slot_cap = 0;         // power of two
+uint32_t search_dead = 0;           // evicted messages still in the lists
+uint64_t search_ann_floor = 1;      // announcements below this are out of the lists
+
+static int search_wordch(unsigned char c) { return c >= 0x80 || isalnum(c); }
+
+/* Words of text, lowercased and cut to SEARCH_TERM_MAX-1 bytes. */
+static int search_tokenize(const char* text, char (*out)[SEARCH_TERM_MAX], int max) {
+    const unsigned char* p = (const unsigned char*)text;
+    int n = 0;
+    while (n < max) {
+        while (*p && !search_wordch(*p)) ++p;
+        if (!*p) break;
+        int k = 0;
+        for (; search_wordch(*p); ++p)
+            if (k < SEARCH_TERM_MAX - 1) out[n][k++] = (char)tolower(*p);
+        out[n++][k] = '\0';
+    }
+    return n;
+}
+
+static void search_slots_grow(void) {
+    size_t cap = search_slot_cap ? search_slot_cap * 2 : 1024;
+    uint32_t* slots = (uint32_t*)mem_calloc(MEM_SEARCH, cap * sizeof(uint32_t));
+    for (uint32_t t = 0; t < search_term_count; ++t) {
+        size_t i = hash_username(search_terms[t].term) & (cap - 1);
+        while (slots[i]) i = (i + 1) & (cap - 1);
+        slots[i] = t + 1;
+    }
+    mem_free(MEM_SEARCH, search_term_slots, search_slot_cap * sizeof(uint32_t));
+    search_term_slots = slots;
+    search_slot_cap = cap;
+}
+
+/* Postings of term; with create, an empty list is added when missing.
+   Pointers are valid until the next term is created. */
+static Posting* search_term_find(const char* term, int create) {
+    if (create && (size_t)(search_term_count + 1) * 2 > search_slot_cap) search_slots_grow();
+    if (!search_slot_cap) return NULL;
+    size_t mask = search_slot_cap - 1, i = hash_username(term) & mask;
+    for (; search_term_slots[i]; i = (i + 1) & mask) {
+        Posting* p = &search_terms[search_term_slots[i] - 1];
+        if (strcmp(p->term, term) == 0) return p;
+    }
+    if (!create) return NULL;
+    if (search_term_count == search_term_cap) {
+        uint32_t old = search_term_cap;
+        search_term_cap = search_term_cap ? search_term_cap * 2 : 1024;
+        search_terms = (Posting*)mem_realloc(MEM_SEARCH, search_terms, old * sizeof(Posting), search_term_cap * sizeof(Posting));
+    }
+    Posting* p = &search_terms[search_term_count];
+    memset(p, 0, sizeof(*p));
+    strcpy(p->term, term);
+    search_term_slots[i] = ++search_term_count;
+    return p;
+}
+
+static void posting_reserve(Posting* p, size_t n) {
+    if (p->len + n <= p->cap) return;
+    size_t old = p->cap;
+    if (!p->cap) p->cap = 16;
+    while (p->len + n > p->cap) p->cap *= 2;
+    p->data = (uint8_t*)mem_realloc(MEM_SEARCH, p->data, old, p->cap);
+}
+
+static void posting_put(Posting* p, uint32_t v) {
+    posting_reserve(p, 5);
+    while (v >= 0x80) { p->data[p->len++] = (uint8_t)(v | 0x80); v >>= 7; }
+    p->data[p->len++] = (uint8_t)v;
+}
+
+/* Start the entry for doc (above last_doc) with count positions to follow. */
+static void posting_begin(Posting* p, uint32_t doc, uint32_t count) {
+    if (p->df % SEARCH_SKIP_EVERY == 0) {
+        if (p->nskip == p->skip_cap) {
+            uint32_t old = p->skip_cap;
+            p->skip_cap = p->skip_cap ? p->skip_cap * 2 : 4;
+            p->skips = (PostingSkip*)mem_realloc(MEM_SEARCH, p->skips, old * sizeof(PostingSkip), p->skip_cap * sizeof(PostingSkip));
+        }
+        p->skips[p->nskip].doc = doc;
+        p->skips[p->nskip++].offset = (uint32_t)p->len;
+    }
+    posting_put(p, doc - p->last_doc);
+    posting_put(p, count);
+    p->last_doc = doc;
+    p->df++;
+}
+
+static uint32_t varint_get(const uint8_t** pp) {
+    const uint8_t* p = *pp;
+    uint32_t v = 0;
+    int shift = 0;
+    while (*p & 0x80) { v |= (uint32_t)(*p++ & 0x7f) << shift; shift += 7; }
+    v |= (uint32_t)*p++ << shift;
+    *pp = p;
+    return v;
+}
+
+static int search_token_cmp(const void* a, const void* b) {
+    const SearchToken* x = (const SearchToken*)a;
+    const SearchToken* y = (const SearchToken*)b;
+    int c = strcmp(x->term, y->term);
+    return c ? c : x->pos - y->pos;
+}
+
+/* Add one document and return its id. Tokenizing and sorting happen
+   before the lock is taken; only the appends run under it. */
+static uint32_t search_add(const SearchDoc* d, const char* text) {
+    char words[SEARCH_MAX_TOKENS][SEARCH_TERM_MAX];
+    SearchToken tok[SEARCH_MAX_TOKENS];
+    int n = search_tokenize(text, words, SEARCH_MAX_TOKENS);
+    for (int i = 0; i < n; ++i) { tok[i].term = words[i]; tok[i].pos = i; }
+    qsort(tok, (size_t)n, sizeof(SearchToken), search_token_cmp);
+
+    pthread_rwlock_wrlock(&search_lock);
+    if (search_doc_count + 1 >= search_doc_cap) {
+        uint32_t old = search_doc_cap;
+        search_doc_cap = search_doc_cap ? search_doc_cap * 2 : 1024;
+        search_docs = (SearchDoc*)mem_realloc(MEM_SEARCH, search_docs, old * sizeof(SearchDoc), search_doc_cap * sizeof(SearchDoc));
+    }
+    uint32_t doc = ++search_doc_count;
+    search_docs[doc] = *d;
+    for (int i = 0, j; i < n; i = j) {
+        for (j = i + 1; j < n && strcmp(tok[j].term, tok[i].term) == 0; ++j) {}
+        Posting* p = search_term_find(tok[i].term, 1);
+        posting_begin(p, doc, (uint32_t)(j - i));
+        for (int k = i, prev = 0; k < j; prev = tok[k++].pos) posting_put(p, (uint32_t)(tok[k].pos - prev));
+    }
+    pthread_rwlock_unlock(&search_lock);
+    return doc;
+}
+
+uint32_t search_index_message(const Conversation* c, const MsgRecord* m) {
+    SearchDoc d = { m, c, 0, m->ts };
+    return search_add(&d, m->text);
+}
+
+/* A message record moved (m) or was evicted (NULL). Evicted documents
+   never match again and leave the postings at the next search_compact. */
+void search_retarget(uint32_t doc, const MsgRecord* m) {
+    if (!doc) return;
+    pthread_rwlock_wrlock(&search_lock);
+    search_docs[doc].msg = m;
+    if (!m) { search_docs[doc].conv = NULL; search_dead++; }
+    pthread_rwlock_unlock(&search_lock);
+}
+
+void search_index_announcement(const Announcement* a) {
+    SearchDoc d = { NULL, NULL, a->seq, a->ts };
+    search_add(&d, a->text);
+}
+
+typedef struct PostingIter {
+    const uint8_t* p;
+    const uint8_t* end;
+    uint32_t doc;       // current document, UINT32_MAX once exhausted
+    uint32_t npos;
+    const uint8_t* pos; // its position gaps
+    const uint8_t* data;
+    const PostingSkip* skips;
+    uint32_t nskip, skip; // skips[skip] is at or before the current entry
+} PostingIter;
+
+static void posting_iter(PostingIter* it, const Posting* p) {
+    it->data = it->p = p->data;
+    it->end = p->data + p->len;
+    it->doc = 0;
+    it->skips = p->skips;
+    it->nskip = p->nskip;
+    it->skip = 0;
+}
+
+static void posting_next(PostingIter* it) {
+    if (it->p >= it->end) { it->doc = UINT32_MAX; return; }
+    it->doc += varint_get(&it->p);
+    it->npos = varint_get(&it->p);
+    it->pos = it->p;
+    for (uint32_t i = 0; i < it->npos; ++i) while (*it->p++ & 0x80) {}
+}
+
+/* Move to the first entry with doc id >= target: jump to the last skip at
+   or before target when it lies ahead, then step through its block. */
+static void posting_seek(PostingIter* it, uint32_t target) {
+    if (it->doc >= target) return;
+    uint32_t lo = it->skip, hi = it->nskip;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (it->skips[mid].doc <= target) lo = mid; else hi = mid;
+    }
+    if (lo < it->nskip && it->data + it->skips[lo].offset >= it->p) {
+        const uint8_t* q = it->data + it->skips[lo].offset;
+        uint32_t gap = varint_get(&q);
+        it->p = it->data + it->skips[lo].offset;
+        it->doc = it->skips[lo].doc - gap; // posting_next adds the gap back
+        it->skip = lo;
+        posting_next(it);
+    }
+    while (it->doc < target) posting_next(it);
+}
+
+/* Positions of the current document as a bitmap; a document has at most
+   SEARCH_MAX_TOKENS words. */
+static void posting_bits(const PostingIter* it, uint64_t bits[SEARCH_MAX_TOKENS / 64]) {
+    memset(bits, 0, SEARCH_MAX_TOKENS / 8);
+    const uint8_t* p = it->pos;
+    uint32_t pos = 0;
+    for (uint32_t i = 0; i < it->npos; ++i) {
+        pos += varint_get(&p);
+        if (pos < SEARCH_MAX_TOKENS) bits[pos / 64] |= (uint64_t)1 << (pos % 64);
+    }
+}
+
+typedef struct SearchQuery {
+    char terms[SEARCH_MAX_TERMS][SEARCH_TERM_MAX]; // distinct words
+    int nterms;
+    int words[SEARCH_MAX_TERMS]; // term index of every query word, in order
+    int nwords;
+    int phrase_start[SEARCH_MAX_TERMS], phrase_len[SEARCH_MAX_TERMS]; // runs of words
+    int nphrases;
+} SearchQuery;
+
+static int search_parse(const char* query, SearchQuery* q) {
+    char part[MAX_TEXT];
+    char found[SEARCH_MAX_TERMS][SEARCH_TERM_MAX];
+    q->nterms = q->nwords = q->nphrases = 0;
+    int quoted = 0;
+    for (const char* s = query; ; quoted = !quoted) {
+        const char* e = strchr(s, '"');
+        size_t len = e ? (size_t)(e - s) : strlen(s);
+        if (len >= sizeof(part)) len = sizeof(part) - 1;
+        memcpy(part, s, len);
+        part[len] = '\0';
+        int start = q->nwords;
+        int n = search_tokenize(part, found, SEARCH_MAX_TERMS - q->nwords);
+        for (int i = 0; i < n; ++i) {
+            int t = 0;
+            while (t < q->nterms && strcmp(q->terms[t], found[i]) != 0) ++t;
+            if (t == q->nterms) strcpy(q->terms[q->nterms++], found[i]);
+            q->words[q->nwords++] = t;
+        }
+        if (quoted && q->nwords - start > 1) {
+            q->phrase_start[q->nphrases] = start;
+            q->phrase_len[q->nphrases++] = q->nwords - start;
+        }
+        if (!e) break;
+        s = e + 1;
+    }
+    return q->nterms;
+}
+
+/* Do the current documents of it[] contain every phrase of q? */
+static int search_phrases_match(const SearchQuery* q, const PostingIter* it) {
+    uint64_t bits[SEARCH_MAX_TERMS][SEARCH_MAX_TOKENS / 64];
+    int have[SEARCH_MAX_TERMS] = {0};
+    for (int ph = 0; ph < q->nphrases; ++ph) {
+        uint64_t acc[SEARCH_MAX_TOKENS / 64];
+        for (int i = 0; i < q->phrase_len[ph]; ++i) {
+            int t = q->words[q->phrase_start[ph] + i];
+            if (!have[t]) { posting_bits(&it[t], bits[t]); have[t] = 1; }
+            // keep start positions p whose word i is at p + i
+            uint64_t any = 0;
+            for (int w = 0; w < SEARCH_MAX_TOKENS / 64; ++w) {
+                uint64_t shifted = bits[t][w] >> i;
+                if (i && w + 1 < SEARCH_MAX_TOKENS / 64) shifted |= bits[t][w + 1] << (64 - i);
+                acc[w] = i ? acc[w] & shifted : shifted;
+                any |= acc[w];
+            }
+            if (!any) return 0;
+        }
+    }
+    return 1;
+}
+
+/* Documents matching query that viewer_id may see, newest first, at most
+   max of them. sender_id 0 matches anyone (announcements have no sender);
+   only times in [from, to) match, to 0 meaning no upper bound. Returns the
+   count, or -1 when the query has no words. Takes its locks itself. */
+int search_documents(int viewer_id, const char* query, int sender_id, int64_t from, int64_t to, SearchDoc* out, int max) {
+    SearchQuery q;
+    if (!search_parse(query, &q)) return -1;
+
+    pthread_rwlock_rdlock(&chat_lock);
+    if (viewer_id > 0 && viewer_id < chat_capacity) {
+        mailbox_drain(viewer_id);
+        chat_csr_acquire();
+        int first, peers = chat_peers(viewer_id, &first);
+        for (int i = 0; i < peers; ++i) mailbox_drain(chat_csr_peers[first + i]);
+        pthread_rwlock_unlock(&chat_csr_lock);
+    }
+    pthread_rwlock_unlock(&chat_lock);
+    pthread_rwlock_rdlock(&ann_lock);
+    uint64_t ann_oldest = ann_oldest_seq();
+    pthread_rwlock_unlock(&ann_lock);
+
+    PostingIter it[SEARCH_MAX_TERMS];
+    int order[SEARCH_MAX_TERMS];
+    uint32_t df[SEARCH_MAX_TERMS];
+    int n = 0;
+    pthread_rwlock_rdlock(&search_lock);
+    for (int t = 0; t < q.nterms; ++t) {
+        const Posting* p = search_term_find(q.terms[t], 0);
+        if (!p) { pthread_rwlock_unlock(&search_lock); return 0; }
+        posting_iter(&it[t], p);
+        posting_next(&it[t]);
+        df[t] = p->df;
+        int k = t; // order[] by list length, rarest first
+        for (; k > 0 && df[order[k-1]] > df[t]; --k) order[k] = order[k-1];
+        order[k] = t;
+    }
+    PostingIter* lead = &it[order[0]];
+    while (lead->doc != UINT32_MAX) {
+        uint32_t doc = lead->doc;
+        int k = 1;
+        for (; k < q.nterms; ++k) {
+            PostingIter* o = &it[order[k]];
+            posting_seek(o, doc);
+            if (o->doc != doc) break;
+        }
+        if (k < q.nterms) { // skip the lead up to the first doc that list has
+            uint32_t next = it[order[k]].doc;
+            if (next == UINT32_MAX) break;
+            posting_seek(lead, next);
+            continue;
+        }
+        const SearchDoc* d = &search_docs[doc];
+        int visible = d->msg ? (d->conv->user_a == viewer_id || d->conv->user_b == viewer_id)
+                                && (!sender_id || d->msg->sender_id == sender_id)
+                             : !sender_id && d->ann_seq >= ann_oldest;
+        if (visible && d->ts >= from && (!to || d->ts < to) && (n < max || d->ts >= out[n-1].ts)
+            && search_phrases_match(&q, it)) {
+            int i = n < max ? n++ : n - 1; // newest first; on equal times the later doc first
+            for (; i > 0 && out[i-1].ts <= d->ts; --i) out[i] = out[i-1];
+            out[i] = *d;
+        }
+        posting_next(lead);
+    }
+    pthread_rwlock_unlock(&search_lock);
+    return n;
+}
+
+/* search_documents with every hit resolved to names and text. */
+int search_messages(int viewer_id, const char* query, int sender_id, int64_t from, int64_t to, SearchHit* out, int max) {
+    SearchDoc docs[SEARCH_MAX_HITS];
+    if (max > SEARCH_MAX_HITS) max = SEARCH_MAX_HITS;
+    int n = search_documents(viewer_id, query, sender_id, from, to, docs, max);
+    if (n <= 0) return n;
+    int kept = 0;
+    pthread_rwlock_rdlock(&ann_lock);
+    for (int i = 0; i < n; ++i) {
+        SearchHit* h = &out[kept];
+        h->ts = docs[i].ts;
+        h->sender = h->peer = "";
+        if (docs[i].msg) strcpy(h->text, docs[i].msg->text);
+        else if (docs[i].ann_seq >= ann_oldest_seq()) strcpy(h->text, ann_at(docs[i].ann_seq)->text);
+        else continue; // fell out of the feed since the query ran
+        docs[kept++] = docs[i];
+    }
+    pthread_rwlock_unlock(&ann_lock);
+    pthread_rwlock_rdlock(&users_lock);
+    for (int i = 0; i < kept; ++i) {
+        if (!docs[i].msg) continue;
+        const Conversation* c = docs[i].conv;
+        User* s = find_user_by_id(docs[i].msg->sender_id);
+        User* p = find_user_by_id(c->user_a == viewer_id ? c->user_b : c->user_a);
+        out[i].sender = s ? s->username : "Unknown";
+        out[i].peer = p ? p->username : "Unknown";
+    }
+    pthread_rwlock_unlock(&users_lock);
+    return kept;
+}
+
+/* Drop the entries of documents that can no longer match: messages evicted
+   by retention and announcements that fell out of the feed. Each list is
+   rewritten with its skips, so this only runs once the dead documents are a
+   quarter of all of them, which amortizes it over the drops. Called from
+   checkpoint(), when no command is in flight. Returns entries dropped. */
+long search_compact(void) {
+    pthread_rwlock_rdlock(&ann_lock);
+    uint64_t ann_oldest = ann_oldest_seq();
+    pthread_rwlock_unlock(&ann_lock);
+    pthread_rwlock_wrlock(&search_lock);
+    uint64_t dead = search_dead + (ann_oldest > search_ann_floor ? ann_oldest - search_ann_floor : 0);
+    long dropped = 0;
+    if (dead && dead >= search_doc_count / 4) {
+        for (uint32_t t = 0; t < search_term_count; ++t) {
+            Posting* p = &search_terms[t];
+            Posting old = *p;
+            p->data = NULL; p->len = p->cap = 0; p->last_doc = p->df = 0; p->nskip = 0;
+            PostingIter it;
+            posting_iter(&it, &old);
+            for (posting_next(&it); it.doc != UINT32_MAX; posting_next(&it)) {
+                const SearchDoc* d = &search_docs[it.doc];
+                if (!d->msg && d->ann_seq < ann_oldest) { dropped++; continue; }
+                posting_begin(p, it.doc, it.npos);
+                size_t n = (size_t)(it.p - it.pos);
+                posting_reserve(p, n);
+                memcpy(p->data + p->len, it.pos, n);
+                p->len += n;
+            }
+            mem_free(MEM_SEARCH, old.data, old.cap);
+        }
+        search_dead = 0;
+        search_ann_floor = ann_oldest;
+    }
+    pthread_rwlock_unlock(&search_lock);
+    return dropped;
+}
+
+void search_teardown(void) {
+    for (uint32_t t = 0; t < search_term_count; ++t) {
+        mem_free(MEM_SEARCH, search_terms[t].data, search_terms[t].cap);
+        mem_free(MEM_SEARCH, search_terms[t].skips, search_terms[t].skip_cap * sizeof(PostingSkip));
+    }
+    mem_free(MEM_SEARCH, search_terms, search_term_cap * sizeof(Posting));
+    mem_free(MEM_SEARCH, search_term_slots, search_slot_cap * sizeof(uint32_t));
+    mem_free(MEM_SEARCH, search_docs, search_doc_cap * sizeof(SearchDoc));
+    search_terms = NULL; search_term_count = search_term_cap = 0;
+    search_term_slots = NULL; search_slot_cap = 0;
+    search_docs = NULL; search_doc_count = search_doc_cap = 0;
+    search_dead = 0; search_ann_floor = 1;
+}
+
+/* =========================
+   Syllabus - BST per subject
+   The tree is AVL-balanced, so topics entered in alphabetical order still
+   give O(log n) depth. Every node carries the size and completed count of
+   its subtree: completion is read off the root in O(1) and marking a topic
+   complete updates only the counters on its search path.
+   Subjects live in a registry: a dense array in creation order plus an
+   open-addressing name index. Each entry mirrors its tree's totals, so a
+   report over every subject is one pass over the array.
+   ========================= */
+
+#define TOPIC_MAX_HEIGHT 64 // AVL height bound far beyond any realistic n
+
+typedef struct Topic {
+    char name[128];
+    int completed; // 0/1
+    int height;
+    int size; // topics in this subtree
+    int done; // completed topics in this subtree
+    struct Topic *left, *right;
+} Topic;
+
+typedef struct Subject {
+    char name[MAX_SUBJECT_NAME];
+    int topics;    // topics in the tree
+    int completed; // completed topics in the tree
+    int number;    // 1-based position in subject_list
+    Topic* root;
+} Subject;
+
+Subject** subject_list = NULL; // creation order
+int subject_count = 0, subject_cap = 0;
+Arena syllabus_arena = ARENA_INIT(MEM_SYLLABUS); // subjects and topics
+RadixTree subject_names = RADIX_INIT(MEM_SYLLABUS); // subject name prefixes -> subject number
+RadixTree topic_names = RADIX_INIT(MEM_SYLLABUS);   // topic name prefixes -> number of each subject that has it
+int* subject_index = NULL; // open addressing over subject_list positions, -1 = empty
+unsigned int subject_index_size = 0; // power of two, kept at least twice subject_count
+
+Topic* create_topic_node(const char *name) {
+    Topic* t = (Topic*)arena_alloc(&syllabus_arena, sizeof(Topic), 8);
+    strncpy(t->name, name, sizeof(t->name)-1); t->name[sizeof(t->name)-1] = '\0';
+    t->completed = 0; t->left = t->right = NULL;
+    t->height = 1; t->size = 1; t->done = 0;
+    return t;
+}
+
+static int topic_height(const Topic* t) { return t ? t->height : 0; }
+int topic_count(const Topic* t) { return t ? t->size : 0; }
+int topic_done(const Topic* t) { return t ? t->done : 0; }
+
+/* Recompute a node's height and subtree counters from its children. */
+void topic_update(Topic* t) {
+    int hl = topic_height(t->left), hr = topic_height(t->right);
+    t->height = 1 + (hl > hr ? hl : hr);
+    t->size = 1 + topic_count(t->left) + topic_count(t->right);
+    t->done = (t->completed ? 1 : 0) + topic_done(t->left) + topic_done(t->right);
+}
+
+static Topic* topic_rotate_right(Topic* t) {
+    Topic* l = t->left;
+    t->left = l->right;
+    l->right = t;
+    topic_update(t);
+    topic_update(l);
+    return l;
+}
+
+static Topic* topic_rotate_left(Topic* t) {
+    Topic* r = t->right;
+    t->right = r->left;
+    r->left = t;
+    topic_update(t);
+    topic_update(r);
+    return r;
+}
+
+static Topic* topic_rebalance(Topic* t) {
+    topic_update(t);
+    int bal = topic_height(t->left) - topic_height(t->right);
+    if (bal > 1) {
+        if (topic_height(t->left->left) < topic_height(t->left->right)) t->left = topic_rotate_left(t->left);
+        return topic_rotate_right(t);
+    }
+    if (bal < -1) {
+        if (topic_height(t->right->right) < topic_height(t->right->left)) t->right = topic_rotate_right(t->right);
+        return topic_rotate_left(t);
+    }
+    return t;
+}
+
+Topic* bst_insert(Topic* root, const char* name) {
+    if (!root) return create_topic_node(name);
+    int cmp = strcmp(name, root->name);
+    if (cmp < 0) root->left = bst_insert(root->left, name);
+    else if (cmp > 0) root->right = bst_insert(root->right, name);
+    else return root; /* duplicate; ignore */
+    return topic_rebalance(root);
+}
+
+Topic* bst_search(Topic* root, const char* name) {
+    while (root) {
+        int cmp = strcmp(name, root->name);
+        if (cmp == 0) return root;
+        root = cmp < 0 ? root->left : root->right;
     }
     return NULL;
 }
 
-void create_subject(const char* name) {
-    if (find_subject(name)) { printf("Subject already exists.\n"); return; }
-    Subject* s = (Subject*)malloc(sizeof(Subject));
-    strncpy(s->name, name, MAX_SUBJECT_NAME-1); s->name[MAX_SUBJECT_NAME-1] = '\0';
+Subject* find_subject(const char* name) {
+    if (!subject_index_size) return NULL;
+    unsigned int mask = subject_index_size - 1;
+    for (unsigned int i = hash_username(name) & mask; subject_index[i] >= 0; i = (i + 1) & mask)
+        if (strcmp(subject_list[subject_index[i]]->name, name) == 0) return subject_list[subject_index[i]];
+    return NULL;
+}
+
+static void subject_index_put(int pos) {
+    unsigned int mask = subject_index_size - 1;
+    unsigned int i = hash_username(subject_list[pos]->name) & mask;
+    while (subject_index[i] >= 0) i = (i + 1) & mask;
+    subject_index[i] = pos;
+}
+
+/* Returns 0 on success, -1 if the subject already exists. */
+int create_subject(const char* name) {
+    char key[MAX_SUBJECT_NAME];
+    strncpy(key, name, MAX_SUBJECT_NAME-1); key[MAX_SUBJECT_NAME-1] = '\0';
+    if (find_subject(key)) return -1;
+    Subject* s = (Subject*)arena_alloc(&syllabus_arena, sizeof(Subject), 8);
+    strcpy(s->name, key);
+    s->topics = s->completed = 0;
     s->root = NULL;
-    s->next = subjects;
-    subjects = s;
+    if (subject_count == subject_cap) {
+        int old = subject_cap;
+        subject_cap = subject_cap ? subject_cap * 2 : 16;
+        subject_list = (Subject**)mem_realloc(MEM_SYLLABUS, subject_list, (size_t)old * sizeof(Subject*),
+                                              (size_t)subject_cap * sizeof(Subject*));
+    }
+    subject_list[subject_count++] = s;
+    s->number = subject_count;
+    radix_insert(&subject_names, s->name, s->number);
+    if ((unsigned int)subject_count * 2 > subject_index_size) {
+        unsigned int old = subject_index_size;
+        subject_index_size = subject_index_size ? subject_index_size * 2 : 32;
+        subject_index = (int*)mem_realloc(MEM_SYLLABUS, subject_index, old * sizeof(int), subject_index_size * sizeof(int));
+        memset(subject_index, 0xff, subject_index_size * sizeof(int));
+        for (int i = 0; i < subject_count; ++i) subject_index_put(i);
+    } else subject_index_put(subject_count - 1);
+    wal_log(WAL_SUBJECT, s->name);
+    return 0;
 }
 
-void add_topic_to_subject(const char* subj, const char* topic) {
+/* Returns 0 on success, -1 if the subject does not exist. */
+int add_topic_to_subject(const char* subj, const char* topic) {
     Subject* s = find_subject(subj);
-    if (!s) { printf("Subject not found.\n"); return; }
+    if (!s) return -1;
     s->root = bst_insert(s->root, topic);
+    s->topics = topic_count(s->root);
+    Topic* t = bst_search(s->root, topic);
+    if (t) radix_insert(&topic_names, t->name, s->number);
+    wal_log(WAL_TOPIC, subj, topic);
+    return 0;
 }
 
 void inorder_print_topics(Topic* root) {
-    if (!root) return;
-    inorder_print_topics(root->left);
-    printf(" - %s [%s]\n", root->name, root->completed ? "Completed":"Pending");
-    inorder_print_topics(root->right);
+    Topic* stack[TOPIC_MAX_HEIGHT];
+    int sp = 0;
+    Topic* cur = root;
+    while (cur || sp) {
+        while (cur) { stack[sp++] = cur; cur = cur->left; }
+        cur = stack[--sp];
+        printf(" - %s [%s]\n", cur->name, cur->completed ? "Completed":"Pending");
+        cur = cur->right;
+    }
+}
+
+/* Add every topic of a subtree to the name index (snapshot load). */
+void topic_index_subtree(const Topic* t, int number) {
+    for (; t; t = t->right) {
+        topic_index_subtree(t->left, number);
+        radix_insert(&topic_names, t->name, number);
+    }
+}
+
+#define SUGGEST_MAX 5
+
+/* "Did you mean" line after an exact lookup in t failed. */
+void print_suggestions(const RadixTree* t, const char* typed) {
+    RadixMatch m[SUGGEST_MAX];
+    int n = radix_suggest(t, typed, m, SUGGEST_MAX);
+    if (!n) return;
+    printf("Did you mean:");
+    for (int i = 0; i < n; ++i) {
+        printf("%s %s", i ? "," : "", m[i].key);
+        if (t == &topic_names) printf(" (%s)", subject_list[m[i].value - 1]->name);
+    }
+    printf("?\n");
+}
+
+void view_subject_topics(const char* subj) {
+    Subject* s = find_subject(subj);
+    if (!s) { printf("Subject not found.\n"); print_suggestions(&subject_names, subj); return; }
+    printf("Topics for %s:\n", s->name);
+    inorder_print_topics(s->root);
+}
+
+/* Mark a topic completed and bump the done counters along its path.
+   Returns 0 on success, -1 if the topic is not in the tree. */
+int topic_mark_complete(Topic* root, const char* name) {
+    Topic* path[TOPIC_MAX_HEIGHT];
+    int depth = 0;
+    while (root) {
+        path[depth++] = root;
+        int cmp = strcmp(name, root->name);
+        if (cmp == 0) break;
+        root = cmp < 0 ? root->left : root->right;
+    }
+    if (!root) return -1;
+    if (root->completed) return 0;
+    root->completed = 1;
+    while (depth) path[--depth]->done++;
+    return 0;
+}
+
+/* Returns 0 on success, -1 if the subject and -2 if the topic is missing. */
+int mark_topic_complete(const char* subj, const char* topic) {
+    Subject* s = find_subject(subj);
+    if (!s) return -1;
+    if (topic_mark_complete(s->root, topic) != 0) return -2;
+    s->completed = topic_done(s->root);
+    wal_log(WAL_COMPLETE, subj, topic);
+    return 0;
+}
+
+double subject_completion_percent(const char* subj) {
+    Subject* s = find_subject(subj);
+    if (!s) return 0.0;
+    if (s->topics == 0) return 0.0;
+    return (100.0 * s->completed) / s->topics;
+}
+
+/* Drop every subject and topic at once; the syllabus pool is empty afterwards. */
+void syllabus_teardown(void) {
+    mem_free(MEM_SYLLABUS, subject_list, (size_t)subject_cap * sizeof(Subject*));
+    mem_free(MEM_SYLLABUS, subject_index, subject_index_size * sizeof(int));
+    subject_list = NULL; subject_count = subject_cap = 0;
+    subject_index = NULL; subject_index_size = 0;
+    radix_reset(&subject_names);
+    radix_reset(&topic_names);
+    arena_free(&syllabus_arena);
+}
+
+/* =========================
+   Assignments - Min-Heap by dueDate (yyyymmdd integer)
+   Students can submit -> update record
+   The heap is HEAP_ARITY-ary and grows on demand. heap_pos maps an
+   assignment id to its slot, so lookup by id is O(1) and a due date
+   change or removal is one O(log n) sift. Ordered listing walks the heap
+   with a small frontier heap instead of copying and sorting it.
+   ========================= */
+
+/* Submissions live in one contiguous array. Each assignment and each
+   student keeps a list of indices into it, and a (assignment, student)
+   map makes a resubmission overwrite the earlier record in place. */
+typedef struct Submission {
+    int64_t ts;
+    int assignment_id; // 0 once the assignment has been removed
+    int student_id;
+    const char* student_name; // interned username, resolved when submitted
+    const char* filename;     // simulation of uploaded file name, in submission_strings
+} Submission;
+
+typedef struct IdList {
+    int* items;
+    int count, cap;
+} IdList;
+
+void idlist_push(IdList* l, int v) {
+    if (l->count == l->cap) {
+        int old = l->cap;
+        l->cap = l->cap ? l->cap * 2 : 4;
+        l->items = (int*)mem_realloc(MEM_ASSIGNMENTS, l->items, (size_t)old * sizeof(int), (size_t)l->cap * sizeof(int));
+    }
+    l->items[l->count++] = v;
+}
+
+typedef struct Assignment {
+    int id;
+    char title[128];
+    int dueDate; // YYYYMMDD as int for priority
+    char description[MAX_TEXT];
+    IdList subs; // indices into submission_store; count = submissions so far
+} Assignment;
+
+Slab assignment_slab = { ARENA_INIT(MEM_ASSIGNMENTS), sizeof(Assignment), NULL };
+Assignment** assignment_heap = NULL;
+int heap_size = 0, heap_cap = 0;
+int* heap_pos = NULL; // heap_pos[id] = slot in assignment_heap, -1 if absent
+int heap_pos_cap = 0;
+int next_assignment_id = 1;
+
+/* Heap order: earlier due date first, ties by id so listings are stable. */
+static int assignment_before(const Assignment* a, const Assignment* b) {
+    return a->dueDate != b->dueDate ? a->dueDate < b->dueDate : a->id < b->id;
+}
+
+static void heap_place(int i, Assignment* a) {
+    assignment_heap[i] = a;
+    heap_pos[a->id] = i;
+}
+
+static void heap_sift_up(int i) {
+    Assignment* a = assignment_heap[i];
+    while (i > 0) {
+        int p = (i - 1) / HEAP_ARITY;
+        if (!assignment_before(a, assignment_heap[p])) break;
+        heap_place(i, assignment_heap[p]);
+        i = p;
+    }
+    heap_place(i, a);
+}
+
+static void heap_sift_down(int i) {
+    Assignment* a = assignment_heap[i];
+    while (1) {
+        int first = HEAP_ARITY * i + 1, best = -1;
+        for (int c = first; c < first + HEAP_ARITY && c < heap_size; ++c)
+            if (best < 0 || assignment_before(assignment_heap[c], assignment_heap[best])) best = c;
+        if (best < 0 || !assignment_before(assignment_heap[best], a)) break;
+        heap_place(i, assignment_heap[best]);
+        i = best;
+    }
+    heap_place(i, a);
+}
+
+Assignment* find_assignment(int id) {
+    if (id <= 0 || id >= heap_pos_cap || heap_pos[id] < 0) return NULL;
+    return assignment_heap[heap_pos[id]];
+}
+
+/* Returns 0 on success, -1 if the id is out of range or already present. */
+int heap_push(Assignment* a) {
+    if (a->id <= 0 || a->id >= MAX_ASSIGNMENT_ID || find_assignment(a->id)) return -1;
+    if (a->id >= heap_pos_cap) {
+        int newcap = heap_pos_cap ? heap_pos_cap : 64;
+        while (newcap <= a->id) newcap *= 2;
+        heap_pos = (int*)mem_realloc(MEM_ASSIGNMENTS, heap_pos, (size_t)heap_pos_cap * sizeof(int), (size_t)newcap * sizeof(int));
+        memset(heap_pos + heap_pos_cap, 0xff, (size_t)(newcap - heap_pos_cap) * sizeof(int));
+        heap_pos_cap = newcap;
+    }
+    if (heap_size == heap_cap) {
+        int old = heap_cap;
+        heap_cap = heap_cap ? heap_cap * 2 : 64;
+        assignment_heap = (Assignment**)mem_realloc(MEM_ASSIGNMENTS, assignment_heap, (size_t)old * sizeof(Assignment*),
+                                                    (size_t)heap_cap * sizeof(Assignment*));
+    }
+    heap_place(heap_size++, a);
+    heap_sift_up(heap_size - 1);
+    if (a->id >= next_assignment_id) next_assignment_id = a->id + 1;
+    wal_log(WAL_ASSIGN, a->id, a->dueDate, a->title, a->description);
+    return 0;
+}
+
+/* Unlink the assignment in slot i and restore heap order. */
+static Assignment* heap_take(int i) {
+    Assignment* a = assignment_heap[i];
+    heap_pos[a->id] = -1;
+    Assignment* last = assignment_heap[--heap_size];
+    if (i < heap_size) {
+        heap_place(i, last);
+        if (i > 0 && assignment_before(last, assignment_heap[(i - 1) / HEAP_ARITY])) heap_sift_up(i);
+        else heap_sift_down(i);
+    }
+    return a;
+}
+
+Assignment* heap_pop() {
+    if (heap_size == 0) return NULL;
+    return heap_take(0);
+}
+
+/* Returns 0 on success, -1 if no such assignment. */
+int heap_update_due(int id, int dueDate) {
+    Assignment* a = find_assignment(id);
+    if (!a) return -1;
+    int i = heap_pos[id];
+    int earlier = dueDate < a->dueDate;
+    a->dueDate = dueDate;
+    if (earlier) heap_sift_up(i); else heap_sift_down(i);
+    wal_log(WAL_DUE, id, dueDate);
+    return 0;
+}
+
+Submission* submission_store = NULL;
+int submission_count = 0, submission_cap = 0;
+IdList* submissions_by_student = NULL; // indexed by student id
+int submissions_by_student_cap = 0;
+typedef struct SubmissionSlot {
+    uint64_t key; // assignment << 32 | student, 0 = empty
+    int idx;
+} SubmissionSlot;
+SubmissionSlot* submission_map = NULL;
+size_t submission_map_cap = 0; // power of two
+Arena submission_strings = ARENA_INIT(MEM_ASSIGNMENTS);
+
+static size_t submission_slot(uint64_t key) {
+    key ^= key >> 33; key *= 0xff51afd7ed558ccdULL; key ^= key >> 33;
+    return (size_t)key & (submission_map_cap - 1);
+}
+
+static int submission_lookup(uint64_t key) {
+    if (!submission_map_cap) return -1;
+    for (size_t i = submission_slot(key); submission_map[i].key; i = (i + 1) & (submission_map_cap - 1))
+        if (submission_map[i].key == key) return submission_map[i].idx;
+    return -1;
+}
+
+static void submission_map_put(uint64_t key, int idx) {
+    if ((size_t)(submission_count + 1) * 10 >= submission_map_cap * 7) {
+        size_t oldcap = submission_map_cap;
+        SubmissionSlot* old = submission_map;
+        submission_map_cap = oldcap ? oldcap * 2 : 256;
+        submission_map = (SubmissionSlot*)mem_calloc(MEM_ASSIGNMENTS, submission_map_cap * sizeof(SubmissionSlot));
+        for (size_t i = 0; i < oldcap; ++i)
+            if (old[i].key) {
+                size_t j = submission_slot(old[i].key);
+                while (submission_map[j].key) j = (j + 1) & (submission_map_cap - 1);
+                submission_map[j] = old[i];
+            }
+        mem_free(MEM_ASSIGNMENTS, old, oldcap * sizeof(SubmissionSlot));
+    }
+    size_t i = submission_slot(key);
+    while (submission_map[i].key) i = (i + 1) & (submission_map_cap - 1);
+    submission_map[i].key = key;
+    submission_map[i].idx = idx;
+}
+
+/* Record (or replace) a student's submission for an assignment. */
+Submission* submission_record(Assignment* a, int student_id, const char* filename, int64_t ts) {
+    char fn[128];
+    strncpy(fn, filename, sizeof(fn)-1); fn[sizeof(fn)-1] = '\0';
+    uint64_t key = (uint64_t)(uint32_t)a->id << 32 | (uint32_t)student_id;
+    int idx = submission_lookup(key);
+    if (idx < 0) {
+        if (submission_count == submission_cap) {
+            int old = submission_cap;
+            submission_cap = submission_cap ? submission_cap * 2 : 64;
+            submission_store = (Submission*)mem_realloc(MEM_ASSIGNMENTS, submission_store, (size_t)old * sizeof(Submission),
+                                                        (size_t)submission_cap * sizeof(Submission));
+        }
+        idx = submission_count;
+        submission_map_put(key, idx);
+        submission_count++;
+        Submission* s = &submission_store[idx];
+        s->assignment_id = a->id;
+        s->student_id = student_id;
+        User* u = find_user_by_id(student_id);
+        s->student_name = u ? u->username : NULL;
+        idlist_push(&a->subs, idx);
+        if (u) { // only real users get a per-student list
+            if (student_id >= submissions_by_student_cap) {
+                int newcap = submissions_by_student_cap ? submissions_by_student_cap : INITIAL_USER_CAP;
+                while (newcap <= student_id) newcap *= 2;
+                submissions_by_student = (IdList*)mem_realloc(MEM_ASSIGNMENTS, submissions_by_student,
+                                                              (size_t)submissions_by_student_cap * sizeof(IdList),
+                                                              (size_t)newcap * sizeof(IdList));
+                memset(submissions_by_student + submissions_by_student_cap, 0,
+                       (size_t)(newcap - submissions_by_student_cap) * sizeof(IdList));
+                submissions_by_student_cap = newcap;
+            }
+            idlist_push(&submissions_by_student[student_id], idx);
+        }
+    } else if (submission_store[idx].assignment_id == 0) {
+        // the id was removed and reused: revive the record under the new assignment
+        submission_store[idx].assignment_id = a->id;
+        idlist_push(&a->subs, idx);
+    }
+    Submission* s = &submission_store[idx];
+    s->ts = ts;
+    s->filename = arena_strdup(&submission_strings, fn);
+    return s;
+}
+
+void free_assignment(Assignment* a) {
+    for (int i = 0; i < a->subs.count; ++i) submission_store[a->subs.items[i]].assignment_id = 0;
+    mem_free(MEM_ASSIGNMENTS, a->subs.items, (size_t)a->subs.cap * sizeof(int));
+    slab_free(&assignment_slab, a);
+}
+
+/* Returns 0 on success, -1 if no such assignment. */
+int heap_remove(int id) {
+    if (!find_assignment(id)) return -1;
+    free_assignment(heap_take(heap_pos[id]));
+    wal_log(WAL_UNASSIGN, id);
+    return 0;
+}
+
+/* In-order walk of the heap: a frontier min-heap of slots starts at the
+   root and each yielded slot contributes its children, so k steps cost
+   O(k log k) and leave assignment_heap untouched. */
+typedef struct HeapIter {
+    int* frontier;
+    int size, cap;
+} HeapIter;
+
+static void heap_iter_push(HeapIter* it, int slot) {
+    if (it->size == it->cap) {
+        it->cap = it->cap ? it->cap * 2 : 16;
+        it->frontier = (int*)realloc(it->frontier, (size_t)it->cap * sizeof(int));
+    }
+    int i = it->size++;
+    while (i > 0) {
+        int p = (i - 1) / 2;
+        if (!assignment_before(assignment_heap[slot], assignment_heap[it->frontier[p]])) break;
+        it->frontier[i] = it->frontier[p];
+        i = p;
+    }
+    it->frontier[i] = slot;
+}
+
+void heap_iter_init(HeapIter* it) {
+    it->frontier = NULL;
+    it->size = it->cap = 0;
+    if (heap_size) heap_iter_push(it, 0);
+}
+
+Assignment* heap_iter_next(HeapIter* it) {
+    if (!it->size) return NULL;
+    int top = it->frontier[0];
+    int last = it->frontier[--it->size];
+    int i = 0;
+    while (1) { // sift last down from the root
+        int l = 2*i + 1, r = l + 1, m = i;
+        int mslot = last;
+        if (l < it->size && assignment_before(assignment_heap[it->frontier[l]], assignment_heap[mslot])) { m = l; mslot = it->frontier[l]; }
+        if (r < it->size && assignment_before(assignment_heap[it->frontier[r]], assignment_heap[mslot])) { m = r; mslot = it->frontier[r]; }
+        if (m == i) break;
+        it->frontier[i] = it->frontier[m];
+        i = m;
+    }
+    if (it->size) it->frontier[i] = last;
+    for (int c = HEAP_ARITY * top + 1; c <= HEAP_ARITY * top + HEAP_ARITY && c < heap_size; ++c)
+        heap_iter_push(it, c);
+    return assignment_heap[top];
+}
+
+void heap_iter_free(HeapIter* it) {
+    free(it->frontier);
+    it->frontier = NULL;
+    it->size = it->cap = 0;
+}
+
+Assignment* peek_min_assignment() {
+    if (heap_size == 0) return NULL;
+    return assignment_heap[0];
+}
+
+Assignment* create_assignment(const char* title, const char* desc, int dueDate) {
+    Assignment* a = (Assignment*)slab_alloc(&assignment_slab);
+    a->id = next_assignment_id++;
+    strncpy(a->title, title, sizeof(a->title)-1); a->title[sizeof(a->title)-1]='\0';
+    strncpy(a->description, desc, sizeof(a->description)-1); a->description[sizeof(a->description)-1]='\0';
+    a->dueDate = dueDate;
+    a->subs.items = NULL;
+    a->subs.count = a->subs.cap = 0;
+    return a;
+}
+
+/* Returns 0 on success, -1 if the assignment does not exist. */
+int submit_assignment_at(int assignment_id, int student_id, const char* filename, int64_t ts) {
+    Assignment* a = find_assignment(assignment_id);
+    if (!a) return -1;
+    Submission* s = submission_record(a, student_id, filename, ts);
+    wal_log(WAL_SUBMIT, assignment_id, student_id, ts, s->filename);
+    return 0;
+}
+
+int submit_assignment(int assignment_id, int student_id, const char* filename) {
+    return submit_assignment_at(assignment_id, student_id, filename, (int64_t)time(NULL));
+}
+
+void list_assignments() {
+    if (heap_size==0) { printf("No assignments.\n"); return; }
+    HeapIter it;
+    heap_iter_init(&it);
+    for (Assignment* a = heap_iter_next(&it); a; a = heap_iter_next(&it)) {
+        printf("ID:%d Title:%s Due:%d Desc:%s\n", a->id, a->title, a->dueDate, a->description);
+        if (!a->subs.count) printf("  No submissions yet.\n");
+        else {
+            printf("  Submissions (%d):\n", a->subs.count);
+            for (int i = 0; i < a->subs.count; ++i) {
+                const Submission* s = &submission_store[a->subs.items[i]];
+                char timestr[64];
+                time_t ts = (time_t)s->ts;
+                struct tm *tm = localtime(&ts);
+                strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", tm);
+                printf("   - %s (by %s) at %s\n", s->filename, s->student_name ? s->student_name : "Unknown", timestr);
+            }
+        }
+    }
+    heap_iter_free(&it);
+}
+
+void list_student_submissions(int student_id) {
+    int n = 0;
+    if (student_id > 0 && student_id < submissions_by_student_cap) {
+        const IdList* l = &submissions_by_student[student_id];
+        for (int i = 0; i < l->count; ++i) {
+            const Submission* s = &submission_store[l->items[i]];
+            const Assignment* a = find_assignment(s->assignment_id);
+            if (!a) continue;
+            char timestr[64];
+            time_t ts = (time_t)s->ts;
+            struct tm *tm = localtime(&ts);
+            strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", tm);
+            printf(" - ID:%d %s: %s at %s\n", a->id, a->title, s->filename, timestr);
+            n++;
+        }
+    }
+    if (!n) printf("No submissions yet.\n");
+}
+
+/* Drop every assignment and submission; the assignments pool is empty afterwards. */
+void assignments_teardown(void) {
+    for (int i = 0; i < heap_size; ++i)
+        mem_free(MEM_ASSIGNMENTS, assignment_heap[i]->subs.items, (size_t)assignment_heap[i]->subs.cap * sizeof(int));
+    for (int i = 0; i < submissions_by_student_cap; ++i)
+        mem_free(MEM_ASSIGNMENTS, submissions_by_student[i].items, (size_t)submissions_by_student[i].cap * sizeof(int));
+    mem_free(MEM_ASSIGNMENTS, assignment_heap, (size_t)heap_cap * sizeof(Assignment*));
+    mem_free(MEM_ASSIGNMENTS, heap_pos, (size_t)heap_pos_cap * sizeof(int));
+    mem_free(MEM_ASSIGNMENTS, submission_store, (size_t)submission_cap * sizeof(Submission));
+    mem_free(MEM_ASSIGNMENTS, submissions_by_student, (size_t)submissions_by_student_cap * sizeof(IdList));
+    mem_free(MEM_ASSIGNMENTS, submission_map, submission_map_cap * sizeof(SubmissionSlot));
+    slab_reset(&assignment_slab);
+    arena_free(&submission_strings);
+    assignment_heap = NULL; heap_size = heap_cap = 0;
+    heap_pos = NULL; heap_pos_cap = 0;
+    next_assignment_id = 1;
+    submission_store = NULL; submission_count = submission_cap = 0;
+    submissions_by_student = NULL; submissions_by_student_cap = 0;
+    submission_map = NULL; submission_map_cap = 0;
+}
+
+/* =========================
+   Reports & Admin
+   ========================= */
+
+void list_users() {
+    printf("Users (%d):\n", total_users);
+    for (int i=1;i<users_by_id_cap;i++) {
+        User* cur = users_by_id[i];
+        if (!cur) continue;
+        printf(" - ID:%d Username:%s Role:%s\n", cur->id, cur->username,
+               cur->role==ROLE_ADMIN?"Admin": cur->role==ROLE_TEACHER?"Teacher":"Student");
+    }
+}
+
+void syllabus_report() {
+    if (!subject_count) { printf("No subjects.\n"); return; }
+    for (int i = 0; i < subject_count; ++i) {
+        const Subject* cur = subject_list[i];
+        double p = cur->topics ? (100.0 * cur->completed) / cur->topics : 0.0;
+        printf("Subject: %s  Completion: %.2f%%\n", cur->name, p);
+    }
+}
+
+/* Live bytes, objects, high-water mark and allocator calls of every pool. */
+void print_mem_stats(FILE* out) {
+    size_t bytes = 0, objects = 0, calls = 0;
+    fprintf(out, "%-16s %14s %14s %12s %12s\n", "pool", "live bytes", "peak bytes", "objects", "mallocs");
+    for (int i = 0; i < MEM_POOLS; ++i) {
+        const MemPool* p = &mem_pools[i];
+        size_t b = __atomic_load_n(&p->bytes, __ATOMIC_RELAXED), k = __atomic_load_n(&p->peak, __ATOMIC_RELAXED);
+        size_t o = __atomic_load_n(&p->objects, __ATOMIC_RELAXED), c = __atomic_load_n(&p->calls, __ATOMIC_RELAXED);
+        fprintf(out, "%-16s %14zu %14zu %12zu %12zu\n", p->name, b, k, o, c);
+        bytes += b; objects += o; calls += c;
+    }
+    fprintf(out, "%-16s %14zu %14s %12zu %12zu\n", "total", bytes, "", objects, calls); // peaks fall at different times
+}
+
+/* =========================
+   File Save/Load (simple text formats)
+   ========================= */
+
+/* Users file: one "id|username|sha256-hex|role" line per user. Files
+   written before passwords were digested carry the plain password in the
+   third field; any value that is not 64 hex digits is digested on load. */
+
+void digest_to_hex(const unsigned char d[DIGEST_LEN], char out[2*DIGEST_LEN+1]) {
+    static const char hx[] = "0123456789abcdef";
+    for (int i = 0; i < DIGEST_LEN; ++i) { out[2*i] = hx[d[i] >> 4]; out[2*i+1] = hx[d[i] & 15]; }
+    out[2*DIGEST_LEN] = '\0';
+}
+
+int hex_to_digest(const char* s, unsigned char d[DIGEST_LEN]) {
+    if (strlen(s) != 2*DIGEST_LEN) return -1;
+    for (int i = 0; i < 2*DIGEST_LEN; ++i) {
+        char c = s[i];
+        int v = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (v < 0) return -1;
+        if (i & 1) d[i/2] |= (unsigned char)v; else d[i/2] = (unsigned char)(v << 4);
+    }
+    return 0;
+}
+
+void save_users_to_file(const char* fname) {
+    FILE* f = fopen(fname, "w");
+    if (!f) { printf("Unable to open file for users save.\n"); return; }
+    char hex[2*DIGEST_LEN+1];
+    for (int i=1;i<users_by_id_cap;i++) {
+        User* cur = users_by_id[i];
+        if (!cur) continue;
+        digest_to_hex(cur->pw_digest, hex);
+        fprintf(f, "%d|%s|%s|%d\n", cur->id, cur->username, hex, (int)cur->role);
+    }
+    fclose(f);
+    printf("Users saved to %s\n", fname);
+}
+
+/* Bulk import: the file is memory-mapped and scanned in place. A SIMD
+   scanner (SSE2, or NEON on AArch64) finds the next '|' or newline sixteen
+   bytes at a time, and the newline count from a first pass presizes the
+   user table so the import never rehashes. Records go straight into the
+   user pages. Nothing is logged per user; one synchronous checkpoint at
+   the end makes the whole import durable. Every rejected line is reported
+   with its line number and reason (the first IMPORT_REPORT_MAX in full). */
+
+#define IMPORT_REPORT_MAX 20
+
+/* First '|' or '\n' in [p, end), or end. */
+static const char* scan_delim(const char* p, const char* end) {
+#if defined(__SSE2__)
+    const __m128i bar = _mm_set1_epi8('|'), nl = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        unsigned m = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, bar), _mm_cmpeq_epi8(v, nl)));
+        if (m) return p + __builtin_ctz(m);
+        p += 16;
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    const uint8x16_t bar = vdupq_n_u8('|'), nl = vdupq_n_u8('\n');
+    while (end - p >= 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)p);
+        if (vmaxvq_u8(vorrq_u8(vceqq_u8(v, bar), vceqq_u8(v, nl)))) break; // found: locate it below
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '|' && *p != '\n') ++p;
+    return p;
+}
+
+static size_t count_lines(const char* p, const char* end) {
+    size_t n = 0;
+#if defined(__SSE2__)
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (; end - p >= 16; p += 16)
+        n += (size_t)__builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), nl)));
+#endif
+    for (; p < end; ++p) n += *p == '\n';
+    return n;
+}
+
+static int parse_uint(const char* p, const char* end, long max, long* out) {
+    if (p == end || end - p > 9) return -1;
+    long v = 0;
+    for (; p < end; ++p) {
+        if (*p < '0' || *p > '9') return -1;
+        v = v * 10 + (*p - '0');
+    }
+    if (v > max) return -1;
+    *out = v;
+    return 0;
+}
+
+static const char* import_user_line(const char* p, const char* end) {
+    const char* f[4];
+    size_t len[4];
+    int n = 0;
+    while (1) {
+        const char* d = scan_delim(p, end);
+        if (n == 4) return "too many fields";
+        f[n] = p; len[n] = (size_t)(d - p); n++;
+        if (d == end) break;
+        p = d + 1;
+    }
+    if (n != 4) return "expected id|username|digest|role";
+    long id, role;
+    if (parse_uint(f[0], f[0] + len[0], MAX_USER_ID - 1, &id) != 0 || id <= 0) return "bad id";
+    if (parse_uint(f[3], f[3] + len[3], ROLE_ADMIN, &role) != 0 || role < ROLE_STUDENT) return "bad role";
+    if (!len[1] || len[1] >= MAX_NAME) return "bad username";
+    char name[MAX_NAME], secret[2*DIGEST_LEN+1];
+    memcpy(name, f[1], len[1]); name[len[1]] = '\0';
+    if (len[2] > 2*DIGEST_LEN) return "bad digest";
+    memcpy(secret, f[2], len[2]); secret[len[2]] = '\0';
+    unsigned char d[DIGEST_LEN];
+    if (hex_to_digest(secret, d) != 0) {
+        if (len[2] >= MAX_NAME) return "bad digest";
+        password_digest(name, secret, d); // legacy plain-text password
+    }
+    if (!user_id_plausible((int)id)) return "id too far above the highest id";
+    if (!user_id_available((int)id)) return "duplicate id";
+    if (find_user_by_name(name)) return "duplicate username";
+    if (!insert_user_record((int)id, name, d, (Role)role)) return "rejected";
+    return NULL;
 }
 
-void view_subject_topics(const char* subj) {
-    Subject* s = find_subject(subj);
-    if (!s) { printf("Subject not found.\n"); return; }
-    printf("Topics for %s:\n", s->name);
-    inorder_print_topics(s->root);
+void load_users_from_file(const char* fname) {
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) { printf("No users file to load.\n"); return; }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) { close(fd); printf("Users file %s is empty.\n", fname); return; }
+    const char* data = (const char*)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) { printf("Unable to map %s.\n", fname); return; }
+    posix_madvise((void*)data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+    const char* end = data + st.st_size;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    size_t lines = count_lines(data, end) + 1;
+    if (lines > MAX_USER_ID) lines = MAX_USER_ID;
+    user_table_reserve((unsigned int)(total_users + lines));
+
+    long lineno = 0, loaded = 0, rejected = 0;
+    wal_suspended++;
+    for (const char* p = data; p < end; ) {
+        const char* nl = memchr(p, '\n', (size_t)(end - p));
+        const char* eol = nl ? nl : end;
+        ++lineno;
+        const char* le = eol > p && eol[-1] == '\r' ? eol - 1 : eol;
+        if (le > p) {
+            const char* why = import_user_line(p, le);
+            if (!why) loaded++;
+            else if (++rejected <= IMPORT_REPORT_MAX) printf("  line %ld rejected: %s\n", lineno, why);
+        }
+        p = eol + 1;
+    }
+    wal_suspended--;
+    munmap((void*)data, (size_t)st.st_size);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (double)(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    if (rejected > IMPORT_REPORT_MAX) printf("  ... and %ld more rejected lines\n", rejected - IMPORT_REPORT_MAX);
+    printf("Users loaded from %s (%ld added, %ld rejected) in %.3f s\n", fname, loaded, rejected, secs);
+    if (loaded && checkpoint(0) != 0) printf("Unable to write snapshot; the import is not durable yet.\n");
+}
+
+/* =========================
+   Binary snapshot - every subsystem in one file, loadable via mmap.
+   Layout: SnapHeader, then sections located by the header's table. Records
+   hold no pointers: strings are offsets into the STRINGS section and each
+   conversation's messages are a byte range of the MESSAGES section laid
+   out exactly like in-memory MsgRecords, so a log is restored with one
+   memcpy. Topics are stored in sorted order and rebuilt as a balanced
+   tree without comparisons. Everything else is rebuilt record by record
+   on load: users are reinserted, messages re-tokenized into the search
+   index, announcements pushed into the feed, so loading is O(data) and
+   only saves the parsing and per-message copies. The file is written to a
+   temporary name and renamed into place, so a crash never leaves a torn
+   snapshot.
+   ========================= */
+
+#define SNAP_MAGIC "CLSNAP\0\0"
+#define SNAP_VERSION 3 // v2 appends wal_lsn/wal_seg to the header, v3 read state to SnapConv
+#define SNAP_ENDIAN 0x01020304u
+
+enum { SNAP_STRINGS, SNAP_USERS, SNAP_CONVS, SNAP_MESSAGES, SNAP_SUBJECTS, SNAP_TOPICS,
+       SNAP_ANNOUNCEMENTS, SNAP_ASSIGNMENTS, SNAP_SUBMISSIONS, SNAP_SECTIONS };
+
+typedef struct SnapSection { uint64_t offset, size; uint32_t count, pad; } SnapSection;
+
+typedef struct SnapHeader {
+    char magic[8];
+    uint32_t version, endian;
+    uint64_t file_size;
+    int32_t next_user_id, next_assignment_id;
+    SnapSection sections[SNAP_SECTIONS];
+    uint64_t wal_lsn; // last WAL record reflected in this snapshot
+    uint32_t wal_seg, pad; // first WAL segment that may hold newer records
+} SnapHeader;
+
+#define SNAP_HEADER_V1 offsetof(SnapHeader, wal_lsn)
+#define SNAP_CONV_V2 offsetof(SnapConv, next)
+
+typedef struct SnapUser { int32_t id, role; uint32_t name; unsigned char digest[DIGEST_LEN]; } SnapUser;
+typedef struct SnapConv {
+    int32_t user_a, user_b; uint32_t count, pad; uint64_t offset, size;
+    uint32_t next[2], unread[2]; // per participant: cursor relative to the first stored message
+} SnapConv;
+typedef struct SnapSubject { uint32_t name, first_topic, topic_count, pad; } SnapSubject;
+typedef struct SnapTopic { uint32_t name, completed; } SnapTopic;
+typedef struct SnapAnnouncement { int64_t ts; uint32_t text, pad; } SnapAnnouncement;
+typedef struct SnapAssignment { int32_t id, due; uint32_t title, desc, first_sub, sub_count; } SnapAssignment;
+typedef struct SnapSubmission { int64_t ts; int32_t student_id; uint32_t filename; } SnapSubmission;
+
+typedef struct SnapBuf { char* data; size_t len, cap; uint32_t count; } SnapBuf;
+
+static uint64_t snapbuf_put(SnapBuf* b, const void* p, size_t n) {
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->len + n) cap *= 2;
+        b->data = (char*)realloc(b->data, cap);
+        b->cap = cap;
+    }
+    uint64_t off = b->len;
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+    return off;
+}
+
+static uint32_t snap_str(SnapBuf* strs, const char* s) {
+    return (uint32_t)snapbuf_put(strs, s, strlen(s) + 1);
+}
+
+static void snap_topics_inorder(Topic* t, SnapBuf* topics, SnapBuf* strs) {
+    if (!t) return;
+    snap_topics_inorder(t->left, topics, strs);
+    SnapTopic st = { snap_str(strs, t->name), (uint32_t)(t->completed ? 1 : 0) };
+    snapbuf_put(topics, &st, sizeof(st));
+    topics->count++;
+    snap_topics_inorder(t->right, topics, strs);
+}
+
+int save_snapshot(const char* fname) {
+    SnapBuf sec[SNAP_SECTIONS];
+    memset(sec, 0, sizeof(sec));
+    snapbuf_put(&sec[SNAP_STRINGS], "", 1); // offset 0 is the empty string
+    chat_drain_all(); // pending mailbox messages belong in the snapshot
+
+    for (int i = 1; i < users_by_id_cap; ++i) {
+        User* u = users_by_id[i];
+        if (!u) continue;
+        SnapUser su;
+        memset(&su, 0, sizeof(su));
+        su.id = u->id; su.role = (int32_t)u->role; su.name = snap_str(&sec[SNAP_STRINGS], u->username);
+        memcpy(su.digest, u->pw_digest, DIGEST_LEN);
+        snapbuf_put(&sec[SNAP_USERS], &su, sizeof(su));
+        sec[SNAP_USERS].count++;
+    }
+
+    static const char zeros[8] = {0};
+    for (int u = 0; u < chat_capacity; ++u) {
+        for (ChatNode* cn = chat_adj[u]; cn; cn = cn->next) {
+            if (cn->peer_id < u) continue; // each pair once
+            Conversation* c = cn->conv;
+            SnapConv sc = { c->user_a, c->user_b, (uint32_t)c->count, 0, sec[SNAP_MESSAGES].len, 0, {0, 0}, {0, 0} };
+            for (int k = 0; k < 2; ++k) {
+                sc.next[k] = c->next[k] > c->base ? (uint32_t)(c->next[k] - c->base) : 0;
+                sc.unread[k] = (uint32_t)(c->recv[k] - c->seen[k]);
+            }
+            for (size_t i = 0; i < c->count; ++i) {
+                const MsgRecord* m = c->index[i];
+                size_t n = sizeof(MsgRecord) + m->len + 1;
+                snapbuf_put(&sec[SNAP_MESSAGES], m, n);
+                snapbuf_put(&sec[SNAP_MESSAGES], zeros, (8 - (n & 7)) & 7);
+            }
+            sc.size = sec[SNAP_MESSAGES].len - sc.offset;
+            snapbuf_put(&sec[SNAP_CONVS], &sc, sizeof(sc));
+            sec[SNAP_CONVS].count++;
+        }
+    }
+
+    for (int si = 0; si < subject_count; ++si) {
+        Subject* sj = subject_list[si];
+        SnapSubject ss = { snap_str(&sec[SNAP_STRINGS], sj->name), sec[SNAP_TOPICS].count, 0, 0 };
+        snap_topics_inorder(sj->root, &sec[SNAP_TOPICS], &sec[SNAP_STRINGS]);
+        ss.topic_count = sec[SNAP_TOPICS].count - ss.first_topic;
+        snapbuf_put(&sec[SNAP_SUBJECTS], &ss, sizeof(ss));
+        sec[SNAP_SUBJECTS].count++;
+    }
+
+    for (uint64_t seq = ann_next_seq; seq-- > ann_oldest_seq(); ) { // newest first
+        const Announcement* a = ann_at(seq);
+        SnapAnnouncement sa = { a->ts, snap_str(&sec[SNAP_STRINGS], a->text), 0 };
+        snapbuf_put(&sec[SNAP_ANNOUNCEMENTS], &sa, sizeof(sa));
+        sec[SNAP_ANNOUNCEMENTS].count++;
+    }
+
+    for (int i = 0; i < heap_size; ++i) {
+        Assignment* a = assignment_heap[i];
+        SnapAssignment sa = { a->id, a->dueDate, snap_str(&sec[SNAP_STRINGS], a->title),
+                              snap_str(&sec[SNAP_STRINGS], a->description), sec[SNAP_SUBMISSIONS].count, 0 };
+        for (int k = 0; k < a->subs.count; ++k) {
+            const Submission* sb = &submission_store[a->subs.items[k]];
+            SnapSubmission ssb = { sb->ts, sb->student_id, snap_str(&sec[SNAP_STRINGS], sb->filename) };
+            snapbuf_put(&sec[SNAP_SUBMISSIONS], &ssb, sizeof(ssb));
+            sec[SNAP_SUBMISSIONS].count++;
+        }
+        sa.sub_count = sec[SNAP_SUBMISSIONS].count - sa.first_sub;
+        snapbuf_put(&sec[SNAP_ASSIGNMENTS], &sa, sizeof(sa));
+        sec[SNAP_ASSIGNMENTS].count++;
+    }
+
+    SnapHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAP_MAGIC, 8);
+    h.version = SNAP_VERSION;
+    h.endian = SNAP_ENDIAN;
+    h.next_user_id = next_user_id;
+    h.next_assignment_id = next_assignment_id;
+    h.wal_lsn = wal_last_lsn;
+    h.wal_seg = wal_seg;
+    uint64_t off = sizeof(h);
+    for (int i = 0; i < SNAP_SECTIONS; ++i) {
+        off = (off + 7) & ~(uint64_t)7;
+        h.sections[i].offset = off;
+        h.sections[i].size = sec[i].len;
+        h.sections[i].count = sec[i].count;
+        off += sec[i].len;
+    }
+    h.file_size = off;
+
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", fname);
+    FILE* f = fopen(tmp, "wb");
+    int ok = f != NULL;
+    if (ok) ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    for (int i = 0; ok && i < SNAP_SECTIONS; ++i) {
+        size_t pad = (size_t)(h.sections[i].offset - (uint64_t)ftell(f));
+        if (pad) ok = fwrite(zeros, 1, pad, f) == pad;
+        if (ok && sec[i].len) ok = fwrite(sec[i].data, 1, sec[i].len, f) == sec[i].len;
+    }
+    if (f) {
+        if (ok) ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+        if (fclose(f) != 0) ok = 0;
+    }
+    if (ok) ok = rename(tmp, fname) == 0;
+    if (!ok) remove(tmp);
+    for (int i = 0; i < SNAP_SECTIONS; ++i) free(sec[i].data);
+    return ok ? 0 : -1;
 }
 
-Topic* bst_search(Topic* root, const char* name) {
-    if (!root) return NULL;
-    int cmp = strcmp(name, root->name);
-    if (cmp == 0) return root;
-    if (cmp < 0) return bst_search(root->left, name);
-    return bst_search(root->right, name);
-}
+typedef struct SnapView {
+    const char* base;
+    const SnapHeader* h;
+} SnapView;
 
-int count_topics(Topic* root) {
-    if (!root) return 0;
-    return 1 + count_topics(root->left) + count_topics(root->right);
+static const void* snap_records(const SnapView* v, int sec, size_t rec_size) {
+    const SnapSection* s = &v->h->sections[sec];
+    if (s->offset > v->h->file_size || s->size > v->h->file_size - s->offset) return NULL;
+    if ((uint64_t)s->count * rec_size > s->size) return NULL;
+    return v->base + s->offset;
 }
 
-int count_completed(Topic* root) {
-    if (!root) return 0;
-    return (root->completed ? 1 : 0) + count_completed(root->left) + count_completed(root->right);
+static const char* snap_string(const SnapView* v, uint32_t off) {
+    const SnapSection* s = &v->h->sections[SNAP_STRINGS];
+    if (off >= s->size) return "";
+    const char* p = v->base + s->offset + off;
+    return memchr(p, '\0', s->size - off) ? p : "";
 }
 
-void mark_topic_complete(const char* subj, const char* topic) {
-    Subject* s = find_subject(subj);
-    if (!s) { printf("Subject not found.\n"); return; }
-    Topic* t = bst_search(s->root, topic);
-    if (!t) { printf("Topic not found.\n"); return; }
-    t->completed = 1;
-    printf("Marked '%s' as completed in %s.\n", topic, subj);
+static Topic* snap_build_topics(const SnapView* v, const SnapTopic* t, long lo, long hi) {
+    if (lo > hi) return NULL;
+    long mid = lo + (hi - lo) / 2;
+    Topic* n = create_topic_node(snap_string(v, t[mid].name));
+    n->completed = t[mid].completed ? 1 : 0;
+    n->left = snap_build_topics(v, t, lo, mid - 1);
+    n->right = snap_build_topics(v, t, mid + 1, hi);
+    topic_update(n);
+    return n;
 }
 
-double subject_completion_percent(const char* subj) {
-    Subject* s = find_subject(subj);
-    if (!s) return 0.0;
-    int total = count_topics(s->root);
-    if (total == 0) return 0.0;
-    int done = count_completed(s->root);
-    return (100.0 * done) / total;
-}
+/* Load a snapshot into an empty classroom. Returns 0 on success, -1 if the
+   file is missing and -2 if it is malformed. */
+int load_snapshot(const char* fname) {
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < SNAP_HEADER_V1) { close(fd); return -2; }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -2;
 
-/* =========================
-   Assignments - Min-Heap by dueDate (yyyymmdd integer)
-   Students can submit -> update record
-   ========================= */
+    SnapView v = { (const char*)map, (const SnapHeader*)map };
+    const SnapHeader* h = v.h;
+    int rc = -2;
+    if (memcmp(h->magic, SNAP_MAGIC, 8) != 0 || h->version < 1 || h->version > SNAP_VERSION
+        || h->endian != SNAP_ENDIAN || h->file_size != (uint64_t)st.st_size) goto done;
+    if (h->version >= 2 && (size_t)st.st_size < sizeof(SnapHeader)) goto done;
+    wal_suspended++;
 
-typedef struct Submission {
-    int student_id;
-    time_t ts;
-    char filename[128]; // simulation of uploaded file name
-    struct Submission* next;
-} Submission;
+    const SnapUser* users = (const SnapUser*)snap_records(&v, SNAP_USERS, sizeof(SnapUser));
+    size_t conv_size = h->version >= 3 ? sizeof(SnapConv) : SNAP_CONV_V2;
+    const char* convs = (const char*)snap_records(&v, SNAP_CONVS, conv_size);
+    const char* msgs = (const char*)snap_records(&v, SNAP_MESSAGES, 1);
+    const SnapSubject* subs = (const SnapSubject*)snap_records(&v, SNAP_SUBJECTS, sizeof(SnapSubject));
+    const SnapTopic* topics = (const SnapTopic*)snap_records(&v, SNAP_TOPICS, sizeof(SnapTopic));
+    const SnapAnnouncement* anns = (const SnapAnnouncement*)snap_records(&v, SNAP_ANNOUNCEMENTS, sizeof(SnapAnnouncement));
+    const SnapAssignment* asg = (const SnapAssignment*)snap_records(&v, SNAP_ASSIGNMENTS, sizeof(SnapAssignment));
+    const SnapSubmission* sbm = (const SnapSubmission*)snap_records(&v, SNAP_SUBMISSIONS, sizeof(SnapSubmission));
+    if (!users || !convs || !msgs || !subs || !topics || !anns || !asg || !sbm
+        || !snap_records(&v, SNAP_STRINGS, 1)) goto done;
+    uint64_t msgs_size = h->sections[SNAP_MESSAGES].size;
 
-typedef struct Assignment {
-    int id;
-    char title[128];
-    int dueDate; // YYYYMMDD as int for priority
-    char description[MAX_TEXT];
-    Submission* submissions; // linked list of submissions
-} Assignment;
+    user_table_reserve(h->sections[SNAP_USERS].count);
+    for (uint32_t i = 0; i < h->sections[SNAP_USERS].count; ++i) {
+        const SnapUser* su = &users[i];
+        if (su->role < ROLE_STUDENT || su->role > ROLE_ADMIN) continue;
+        insert_user_record(su->id, snap_string(&v, su->name), su->digest, (Role)su->role);
+    }
+    if (h->next_user_id > next_user_id && user_id_plausible(h->next_user_id - 1)) next_user_id = h->next_user_id;
 
-Assignment* assignment_heap[ASSIGNMENT_MAX];
-int heap_size = 0;
-int next_assignment_id = 1;
+    for (uint32_t i = 0; i < h->sections[SNAP_CONVS].count; ++i) {
+        SnapConv sc_buf;
+        memset(&sc_buf, 0, sizeof(sc_buf));
+        memcpy(&sc_buf, convs + (size_t)i * conv_size, conv_size);
+        const SnapConv* sc = &sc_buf;
+        if (h->version < 3) sc_buf.next[0] = sc_buf.next[1] = sc->count; // all read
+        if (sc->offset > msgs_size || sc->size > msgs_size - sc->offset || (sc->offset & 7)) continue;
+        if (!find_user_by_id(sc->user_a) || !find_user_by_id(sc->user_b) || sc->user_a == sc->user_b) continue;
+        add_chat_edge(sc->user_a, sc->user_b);
+        Conversation* c = find_conversation(sc->user_a, sc->user_b);
+        if (!c || c->count || !sc->count) continue;
+        c->log.block_size = (size_t)sc->size;
+        char* blk = (char*)arena_alloc(&c->log, (size_t)sc->size, 8);
+        memcpy(blk, msgs + sc->offset, (size_t)sc->size);
+        c->cap = sc->count;
+        c->index = (MsgRecord**)mem_alloc(MEM_CHAT, c->cap * sizeof(MsgRecord*));
+        c->order = (uint64_t*)mem_calloc(MEM_CHAT, c->cap * sizeof(uint64_t));
+        c->docs = (uint32_t*)mem_alloc(MEM_CHAT, c->cap * sizeof(uint32_t));
+        size_t pos = 0;
+        while (c->count < sc->count && pos + sizeof(MsgRecord) <= sc->size) {
+            MsgRecord* m = (MsgRecord*)(blk + pos);
+            size_t n = sizeof(MsgRecord) + (size_t)m->len + 1;
+            if (m->len > MAX_TEXT || n > sc->size - pos) break;
+            pos += (n + 7) & ~(size_t)7;
+            if (m->sender_id != c->user_a && m->sender_id != c->user_b) continue; // not from this pair
+            m->text[m->len] = '\0';
+            c->docs[c->count] = search_index_message(c, m);
+            c->recv[!conv_side(c, m->sender_id)]++;
+            c->index[c->count++] = m;
+        }
+        for (int k = 0; k < 2; ++k) {
+            c->next[k] = sc->next[k] < c->count ? sc->next[k] : c->count;
+            c->seen[k] = c->recv[k] - (sc->unread[k] < c->recv[k] ? sc->unread[k] : c->recv[k]);
+        }
+    }
 
-void heap_swap(int i, int j) {
-    Assignment* tmp = assignment_heap[i];
-    assignment_heap[i] = assignment_heap[j];
-    assignment_heap[j] = tmp;
-}
+    uint32_t ntopics = h->sections[SNAP_TOPICS].count;
+    for (uint32_t i = 0; i < h->sections[SNAP_SUBJECTS].count; ++i) {
+        const SnapSubject* ss = &subs[i];
+        if (create_subject(snap_string(&v, ss->name)) != 0) continue;
+        Subject* sj = subject_list[subject_count - 1];
+        if (ss->first_topic > ntopics || ss->topic_count > ntopics - ss->first_topic) continue;
+        const SnapTopic* t = topics + ss->first_topic;
+        int sorted = 1;
+        for (uint32_t k = 1; k < ss->topic_count && sorted; ++k)
+            sorted = strcmp(snap_string(&v, t[k-1].name), snap_string(&v, t[k].name)) < 0;
+        if (sorted) sj->root = snap_build_topics(&v, t, 0, (long)ss->topic_count - 1);
+        else for (uint32_t k = 0; k < ss->topic_count; ++k) {
+            sj->root = bst_insert(sj->root, snap_string(&v, t[k].name));
+            if (t[k].completed) topic_mark_complete(sj->root, snap_string(&v, t[k].name));
+        }
+        sj->topics = topic_count(sj->root);
+        sj->completed = topic_done(sj->root);
+        topic_index_subtree(sj->root, sj->number);
+    }
 
-void heap_push(Assignment* a) {
-    if (heap_size >= ASSIGNMENT_MAX) { printf("Assignment heap full.\n"); return; }
-    assignment_heap[heap_size] = a;
-    int i = heap_size++;
-    while (i > 0) {
-        int p = (i - 1) / 2;
-        if (assignment_heap[p]->dueDate <= assignment_heap[i]->dueDate) break;
-        heap_swap(p, i);
-        i = p;
+    for (uint32_t i = h->sections[SNAP_ANNOUNCEMENTS].count; i-- > 0; ) { // oldest pushed first
+        push_announcement_at(snap_string(&v, anns[i].text), anns[i].ts);
     }
-}
 
-Assignment* heap_pop() {
-    if (heap_size == 0) return NULL;
-    Assignment* top = assignment_heap[0];
-    assignment_heap[0] = assignment_heap[--heap_size];
-    int i = 0;
-    while (1) {
-        int l = 2*i + 1, r = 2*i + 2, smallest = i;
-        if (l < heap_size && assignment_heap[l]->dueDate < assignment_heap[smallest]->dueDate) smallest = l;
-        if (r < heap_size && assignment_heap[r]->dueDate < assignment_heap[smallest]->dueDate) smallest = r;
-        if (smallest == i) break;
-        heap_swap(i, smallest);
-        i = smallest;
+    uint32_t nsubs = h->sections[SNAP_SUBMISSIONS].count;
+    for (uint32_t i = 0; i < h->sections[SNAP_ASSIGNMENTS].count; ++i) {
+        const SnapAssignment* sa = &asg[i];
+        Assignment* a = create_assignment(snap_string(&v, sa->title), snap_string(&v, sa->desc), sa->due);
+        a->id = sa->id;
+        if (heap_push(a) != 0) { free_assignment(a); continue; }
+        if (sa->first_sub <= nsubs && sa->sub_count <= nsubs - sa->first_sub)
+            for (uint32_t k = 0; k < sa->sub_count; ++k) {
+                const SnapSubmission* ssb = &sbm[sa->first_sub + k];
+                submission_record(a, ssb->student_id, snap_string(&v, ssb->filename), ssb->ts);
+            }
     }
-    return top;
+    if (h->next_assignment_id > next_assignment_id) next_assignment_id = h->next_assignment_id;
+    if (h->version >= 2) {
+        wal_last_lsn = h->wal_lsn;
+        wal_first_seg = wal_seg = h->wal_seg ? h->wal_seg : 1;
+    }
+    wal_suspended--;
+    rc = 0;
+done:
+    munmap(map, (size_t)st.st_size);
+    return rc;
 }
 
-Assignment* peek_min_assignment() {
-    if (heap_size == 0) return NULL;
-    return assignment_heap[0];
+/* =========================
+   Write-ahead log - segments, recovery and checkpoints
+   The log is split into numbered segments. A checkpoint switches to a new
+   segment, then forks a child that writes the snapshot from its
+   copy-on-write view of memory while the parent keeps serving; once the
+   child succeeds every segment older than the switch is deleted. The
+   snapshot records the last LSN it contains, so recovery replays only the
+   records after it and stops at the first torn or out-of-sequence record.
+   ========================= */
+
+pid_t checkpoint_pid = -1;
+unsigned checkpoint_cover_seg = 0; // segments below this are in the pending snapshot
+
+static void wal_seg_path(char* out, size_t n, unsigned seg) {
+    snprintf(out, n, "%s.%06u", WAL_FILE, seg);
 }
 
-Assignment* create_assignment(const char* title, const char* desc, int dueDate) {
-    Assignment* a = (Assignment*)malloc(sizeof(Assignment));
-    a->id = next_assignment_id++;
-    strncpy(a->title, title, sizeof(a->title)-1); a->title[sizeof(a->title)-1]='\0';
-    strncpy(a->description, desc, sizeof(a->description)-1); a->description[sizeof(a->description)-1]='\0';
-    a->dueDate = dueDate;
-    a->submissions = NULL;
-    return a;
+static int wal_open_segment(unsigned seg) {
+    char path[256];
+    wal_seg_path(path, sizeof(path), seg);
+    if (wal_fd >= 0) close(wal_fd);
+    wal_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    wal_seg = seg;
+    wal_seg_bytes = 0;
+    int dir = open(".", O_RDONLY); // make the new directory entry durable
+    if (dir >= 0) { fsync(dir); close(dir); }
+    return wal_fd >= 0 ? 0 : -1;
 }
 
-void submit_assignment(int assignment_id, int student_id, const char* filename) {
-    // find assignment in heap array (linear search)
-    for (int i=0;i<heap_size;i++) {
-        if (assignment_heap[i]->id == assignment_id) {
-            Submission* s = (Submission*)malloc(sizeof(Submission));
-            s->student_id = student_id;
-            s->ts = time(NULL);
-            strncpy(s->filename, filename, sizeof(s->filename)-1);
-            s->filename[sizeof(s->filename)-1] = '\0';
-            s->next = assignment_heap[i]->submissions;
-            assignment_heap[i]->submissions = s;
-            printf("Submission recorded for assignment %d by user %d\n", assignment_id, student_id);
-            return;
-        }
+static void wal_drop_segments(unsigned upto) {
+    char path[256];
+    for (unsigned seg = wal_first_seg; seg < upto; ++seg) {
+        wal_seg_path(path, sizeof(path), seg);
+        unlink(path);
     }
-    printf("Assignment with id %d not found.\n", assignment_id);
+    if (upto > wal_first_seg) wal_first_seg = upto;
 }
 
-void list_assignments() {
-    if (heap_size==0) { printf("No assignments.\n"); return; }
-    // We'll print a shallow copy sorted by dueDate - easiest approach: copy pointers and sort by dueDate
-    int n = heap_size;
-    Assignment* tmp[ASSIGNMENT_MAX];
-    for (int i=0;i<n;i++) tmp[i] = assignment_heap[i];
-    // simple selection sort for small n
-    for (int i=0;i<n;i++) {
-        int min=i;
-        for (int j=i+1;j<n;j++) if (tmp[j]->dueDate < tmp[min]->dueDate) min = j;
-        if (min!=i) { Assignment* t=tmp[i]; tmp[i]=tmp[min]; tmp[min]=t; }
-    }
-    for (int i=0;i<n;i++) {
-        printf("ID:%d Title:%s Due:%d Desc:%s\n", tmp[i]->id, tmp[i]->title, tmp[i]->dueDate, tmp[i]->description);
-        Submission* s = tmp[i]->submissions;
-        if (!s) printf("  No submissions yet.\n");
-        else {
-            printf("  Submissions:\n");
-            while (s) {
-                User* u = find_user_by_id(s->student_id);
-                char timestr[64];
-                struct tm *tm = localtime(&s->ts);
-                strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", tm);
-                printf("   - %s (by %s) at %s\n", s->filename, u ? u->username : "Unknown", timestr);
-                s = s->next;
-            }
+typedef struct WalFields {
+    int64_t n[4];
+    const char* s[2];
+    const unsigned char* digest;
+} WalFields;
+
+static int wal_decode(const char* p, size_t len, int type, WalFields* f) {
+    size_t pos = 0;
+    int ni = 0, si = 0;
+    for (const char* fmt = wal_formats[type]; *fmt; ++fmt) {
+        if (*fmt == 'i') {
+            int32_t v;
+            if (pos + 4 > len) return -1;
+            memcpy(&v, p + pos, 4); pos += 4; f->n[ni++] = v;
+        } else if (*fmt == 'l') {
+            if (pos + 8 > len) return -1;
+            memcpy(&f->n[ni++], p + pos, 8); pos += 8;
+        } else if (*fmt == 's') {
+            uint32_t n;
+            if (pos + 4 > len) return -1;
+            memcpy(&n, p + pos, 4); pos += 4;
+            if (n >= len - pos || p[pos + n] != '\0') return -1;
+            f->s[si++] = p + pos; pos += n + 1;
+        } else if (*fmt == 'b') {
+            if (pos + DIGEST_LEN > len) return -1;
+            f->digest = (const unsigned char*)p + pos; pos += DIGEST_LEN;
         }
     }
+    return pos == len ? 0 : -1;
 }
 
-/* =========================
-   Reports & Admin
-   ========================= */
+static void wal_apply(int type, const WalFields* f) {
+    switch (type) {
+    case WAL_USER:
+        if (f->n[1] >= ROLE_STUDENT && f->n[1] <= ROLE_ADMIN)
+            insert_user_record((int)f->n[0], f->s[0], f->digest, (Role)f->n[1]);
+        break;
+    case WAL_MESSAGE:
+        if (find_user_by_id((int)f->n[0]) && find_user_by_id((int)f->n[1]))
+            send_message_at((int)f->n[0], (int)f->n[1], f->s[0], f->n[2]);
+        break;
+    case WAL_ANNOUNCE: push_announcement_at(f->s[0], f->n[0]); break;
+    case WAL_SUBJECT: create_subject(f->s[0]); break;
+    case WAL_TOPIC: add_topic_to_subject(f->s[0], f->s[1]); break;
+    case WAL_COMPLETE: mark_topic_complete(f->s[0], f->s[1]); break;
+    case WAL_ASSIGN: {
+        Assignment* a = create_assignment(f->s[0], f->s[1], (int)f->n[1]);
+        a->id = (int)f->n[0];
+        if (heap_push(a) != 0) free_assignment(a);
+        break;
+    }
+    case WAL_DUE: heap_update_due((int)f->n[0], (int)f->n[1]); break;
+    case WAL_UNASSIGN: heap_remove((int)f->n[0]); break;
+    case WAL_SUBMIT: submit_assignment_at((int)f->n[0], (int)f->n[1], f->s[0], f->n[2]); break;
+    }
+}
 
-void list_users() {
-    printf("Users (%d):\n", total_users);
-    for (int i=0;i<HASH_SIZE;i++) {
-        User* cur = user_table[i];
-        while (cur) {
-            printf(" - ID:%d Username:%s Role:%s\n", cur->id, cur->username,
-                   cur->role==ROLE_ADMIN?"Admin": cur->role==ROLE_TEACHER?"Teacher":"Student");
-            cur = cur->next;
+/* Replay one segment. Returns -1 if it does not exist, 1 if it ended in a
+   torn or out-of-sequence record, 0 if it was read to the end. */
+static int wal_replay_segment(unsigned seg, long* applied) {
+    char path[256];
+    wal_seg_path(path, sizeof(path), seg);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); return 1; }
+    size_t size = (size_t)st.st_size;
+    char* map = size ? (char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (size && map == (char*)MAP_FAILED) return 1;
+    size_t pos = 0;
+    int rc = 0;
+    while (pos < size) {
+        uint32_t len, crc;
+        uint64_t lsn;
+        WalFields f;
+        if (size - pos < WAL_HEADER) { rc = 1; break; }
+        memcpy(&len, map + pos, 4);
+        memcpy(&crc, map + pos + 4, 4);
+        memcpy(&lsn, map + pos + 8, 8);
+        int type = (unsigned char)map[pos + 16];
+        if (len > size - pos - WAL_HEADER || crc32_update(0, map + pos + 8, (size_t)len + 9) != crc
+            || type <= 0 || type >= WAL_TYPES || lsn > wal_last_lsn + 1) { rc = 1; break; }
+        if (lsn == wal_last_lsn + 1) {
+            memset(&f, 0, sizeof(f));
+            if (wal_decode(map + pos + WAL_HEADER, len, type, &f) != 0) { rc = 1; break; }
+            wal_apply(type, &f);
+            wal_last_lsn = lsn;
+            (*applied)++;
         }
+        pos += WAL_HEADER + len;
     }
+    if (map) munmap(map, size);
+    return rc;
 }
 
-void syllabus_report() {
-    Subject* cur = subjects;
-    if (!cur) { printf("No subjects.\n"); return; }
-    while (cur) {
-        double p = subject_completion_percent(cur->name);
-        printf("Subject: %s  Completion: %.2f%%\n", cur->name, p);
-        cur = cur->next;
+/* Replay the log tail after the loaded snapshot and open a fresh segment
+   for new records. Returns the number of records applied. */
+long wal_recover(void) {
+    long applied = 0;
+    unsigned seg = wal_first_seg;
+    wal_suspended++;
+    while (1) {
+        int rc = wal_replay_segment(seg, &applied);
+        if (rc < 0) break;
+        seg++;
+        if (rc > 0) break; // later segments cannot continue the sequence
     }
+    wal_suspended--;
+    if (wal_open_segment(seg) != 0) printf("Unable to open %s; changes will not be logged.\n", WAL_FILE);
+    return applied;
 }
 
-/* =========================
-   File Save/Load (simple text formats)
-   ========================= */
+/* Reap a finished background checkpoint; with block set, wait for it. */
+void checkpoint_poll(int block) {
+    if (checkpoint_pid <= 0) return;
+    int status = 0;
+    pid_t r = waitpid(checkpoint_pid, &status, block ? 0 : WNOHANG);
+    if (r == 0) return;
+    checkpoint_pid = -1;
+    if (r > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0) wal_drop_segments(checkpoint_cover_seg);
+    else printf("Background checkpoint failed; the log is kept.\n");
+}
 
-void save_users_to_file(const char* fname) {
-    FILE* f = fopen(fname, "w");
-    if (!f) { printf("Unable to open file for users save.\n"); return; }
-    for (int i=0;i<HASH_SIZE;i++) {
-        User* cur = user_table[i];
-        while (cur) {
-            fprintf(f, "%d|%s|%s|%d\n", cur->id, cur->username, cur->password, (int)cur->role);
-            cur = cur->next;
-        }
+/* Snapshot everything up to now and truncate the log behind it. With
+   background set the snapshot is written by a forked child. */
+int checkpoint(int background) {
+    checkpoint_poll(1);
+    chat_compact((int64_t)time(NULL)); // retention applies before the snapshot
+    search_compact();
+    pthread_mutex_lock(&wal_lock);
+    unsigned cover = wal_seg + 1;
+    int rc = wal_write_group();
+    if (rc == 0 && wal_fd >= 0) rc = wal_open_segment(cover);
+    pthread_mutex_unlock(&wal_lock);
+    if (rc != 0) return -1;
+    if (background) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) _exit(save_snapshot(SNAPSHOT_FILE) == 0 ? 0 : 1);
+        if (pid > 0) { checkpoint_pid = pid; checkpoint_cover_seg = cover; return 0; }
     }
-    fclose(f);
-    printf("Users saved to %s\n", fname);
+    if (save_snapshot(SNAPSHOT_FILE) != 0) return -1;
+    wal_drop_segments(cover);
+    return 0;
 }
 
-void load_users_from_file(const char* fname) {
-    FILE* f = fopen(fname, "r");
-    if (!f) { printf("No users file to load.\n"); return; }
-    char line[512];
-    while (fgets(line, sizeof(line), f)) {
-        int id, role;
-        char uname[MAX_NAME], pwd[MAX_NAME];
-        line[strcspn(line, "\n")] = '\0';
-        if (sscanf(line, "%d|%63[^|]|%63[^|]|%d", &id, uname, pwd, &role) == 4) {
-            // create but preserve id
-            if (find_user_by_name(uname)) continue;
-            User* u = (User*)malloc(sizeof(User));
-            strncpy(u->username, uname, MAX_NAME-1); u->username[MAX_NAME-1]='\0';
-            strncpy(u->password, pwd, MAX_NAME-1); u->password[MAX_NAME-1]='\0';
-            u->role = (Role)role;
-            u->id = id;
-            unsigned int h = hash_username(uname);
-            u->next = user_table[h];
-            user_table[h] = u;
-            total_users++;
-            if (id >= next_user_id) next_user_id = id+1;
-        }
-    }
-    fclose(f);
-    printf("Users loaded from %s\n", fname);
+void wal_commit_point(void) {
+    wal_sync();
+    checkpoint_poll(0);
+    if (wal_fd >= 0 && checkpoint_pid < 0 && wal_seg_bytes >= WAL_CHECKPOINT_BYTES) checkpoint(1);
 }
 
-/* For syllabus and assignments we will skip complex load/save to keep code manageable.
-   Could be added similarly with recursive traversal and parsing.
-*/
+/* Free everything, subsystem by subsystem, after the final checkpoint.
+   Every pool reads zero afterwards. */
+void classroom_teardown(void) {
+    checkpoint_poll(1);
+    search_teardown();
+    chat_teardown();
+    ann_teardown();
+    assignments_teardown();
+    syllabus_teardown();
+    users_teardown();
+    if (wal_fd >= 0) { close(wal_fd); wal_fd = -1; }
+    mem_free(MEM_OTHER, wal_buf, wal_buf_cap);
+    wal_buf = NULL;
+    wal_buf_len = wal_buf_cap = 0;
+}
 
 /* =========================
    Demo / Sample Data Initialization
@@ -589,7 +3577,7 @@ void login_flow() {
     read_str("Username: ", uname, sizeof(uname));
     read_str("Password: ", pwd, sizeof(pwd));
     User* u = find_user_by_name(uname);
-    if (!u || strcmp(u->password, pwd) != 0) { printf("Invalid credentials.\n"); return; }
+    if (!u || !user_check_password(u, pwd)) { printf("Invalid credentials.\n"); return; }
     current_user = u;
     printf("Logged in as %s (id %d)\n", u->username, u->id);
 }
@@ -599,29 +3587,53 @@ void logout_flow() {
     else printf("No user logged in.\n");
 }
 
+/* Local midnight at the start of day d (YYYYMMDD) plus add_days, or -1
+   if d is not a date. */
+static int64_t date_time(int d, int add_days) {
+    if (d <= 0) return -1;
+    struct tm tm = {0};
+    tm.tm_year = d / 10000 - 1900; tm.tm_mon = d / 100 % 100 - 1; tm.tm_mday = d % 100 + add_days;
+    tm.tm_isdst = -1;
+    time_t t = mktime(&tm);
+    return t == (time_t)-1 ? -1 : (int64_t)t;
+}
+
+void print_search_hits(const SearchHit* hits, int n) {
+    char timestr[64];
+    for (int i = 0; i < n; ++i) {
+        time_t ts = (time_t)hits[i].ts;
+        struct tm *tm = localtime(&ts);
+        strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", tm);
+        if (*hits[i].peer) printf("[%s] (chat with %s) %s: %s\n", timestr, hits[i].peer, hits[i].sender, hits[i].text);
+        else printf("[%s] (announcement) %s\n", timestr, hits[i].text);
+    }
+}
+
 /* Chat menu */
 void chat_menu() {
     if (!current_user) { printf("Please login first.\n"); return; }
     while (1) {
         printf("\n--- Chat Menu ---\n");
-        printf("1. List chat peers\n2. Send message\n3. View messages from peer\n4. Back\nChoose: ");
+        printf("1. List chat peers\n2. Send message\n3. View messages from peer\n4. Search messages and announcements\n5. Back\nChoose: ");
         int c = read_int();
         if (c < 0) { printf("(No input) Returning to main menu.\n"); break; }
         if (c == 1) {
-            // list adjacency
-            ChatNode* cur = chat_adj[current_user->id];
-            if (!cur) { printf("No peers.\n"); continue; }
+            ChatUnread* peers;
+            int n = chat_unread_counts(current_user->id, &peers);
+            if (!n) { printf("No peers.\n"); continue; }
             printf("Peers:\n");
-            while (cur) {
-                User* u = find_user_by_id(cur->peer_id);
-                printf(" - ID:%d Name:%s\n", cur->peer_id, u ? u->username : "Unknown");
-                cur = cur->next;
+            for (int i = 0; i < n; ++i) {
+                User* u = find_user_by_id(peers[i].peer_id);
+                printf(" - ID:%d Name:%s", peers[i].peer_id, u ? u->username : "Unknown");
+                if (peers[i].unread) printf(" (%ld unread)", peers[i].unread);
+                printf("\n");
             }
+            free(peers);
         } else if (c == 2) {
             char peername[MAX_NAME], msg[MAX_TEXT];
             read_str("Enter recipient username: ", peername, sizeof(peername));
             User* p = find_user_by_name(peername);
-            if (!p) { printf("User not found.\n"); continue; }
+            if (!p) { printf("User not found.\n"); print_suggestions(&user_names, peername); continue; }
             read_str("Enter message text: ", msg, sizeof(msg));
             send_message(current_user->id, p->id, msg);
             printf("Message sent.\n");
@@ -629,8 +3641,36 @@ void chat_menu() {
             char peername[MAX_NAME];
             read_str("Enter peer username: ", peername, sizeof(peername));
             User* p = find_user_by_name(peername);
-            if (!p) { printf("User not found.\n"); continue; }
-            view_messages_between(current_user->id, p->id);
+            if (!p) { printf("User not found.\n"); print_suggestions(&user_names, peername); continue; }
+            // only what is new since the last visit; the newest page if nothing is
+            long cursor = -1;
+            if (!view_new_messages(current_user->id, p->id))
+                cursor = view_messages_between(current_user->id, p->id, -1, MSG_PAGE_SIZE);
+            while (cursor > 0) {
+                char more[8];
+                read_str("Show older messages? (y/n): ", more, sizeof(more));
+                if (more[0] != 'y' && more[0] != 'Y') break;
+                cursor = view_messages_between(current_user->id, p->id, cursor, MSG_PAGE_SIZE);
+            }
+        } else if (c == 4) {
+            char query[MAX_TEXT], sender[MAX_NAME];
+            read_str("Search for (\"quote\" words to match a phrase): ", query, sizeof(query));
+            read_str("From user (blank = anyone): ", sender, sizeof(sender));
+            int sender_id = 0;
+            if (sender[0]) {
+                User* s = find_user_by_name(sender);
+                if (!s) { printf("User not found.\n"); print_suggestions(&user_names, sender); continue; }
+                sender_id = s->id;
+            }
+            printf("Since date (YYYYMMDD, 0 = any): ");
+            int64_t from = date_time(read_int(), 0);
+            printf("Until date, inclusive (YYYYMMDD, 0 = any): ");
+            int64_t to = date_time(read_int(), 1);
+            SearchHit hits[SEARCH_MAX_HITS];
+            int n = search_messages(current_user->id, query, sender_id, from < 0 ? 0 : from, to < 0 ? 0 : to, hits, SEARCH_MAX_HITS);
+            if (n < 0) printf("Enter at least one word.\n");
+            else if (!n) printf("No matches.\n");
+            else print_search_hits(hits, n);
         } else break;
     }
 }
@@ -647,15 +3687,15 @@ void syllabus_menu() {
             if (current_user->role == ROLE_STUDENT) { printf("Permission denied.\n"); continue; }
             char sub[MAX_SUBJECT_NAME];
             read_str("Subject name: ", sub, sizeof(sub));
-            create_subject(sub);
-            printf("Subject created.\n");
+            if (create_subject(sub) == 0) printf("Subject created.\n");
+            else printf("Subject already exists.\n");
         } else if (c == 2) {
             if (current_user->role == ROLE_STUDENT) { printf("Permission denied.\n"); continue; }
             char sub[MAX_SUBJECT_NAME], topic[128];
             read_str("Subject: ", sub, sizeof(sub));
             read_str("Topic name: ", topic, sizeof(topic));
-            add_topic_to_subject(sub, topic);
-            printf("Topic added.\n");
+            if (add_topic_to_subject(sub, topic) == 0) printf("Topic added.\n");
+            else { printf("Subject not found.\n"); print_suggestions(&subject_names, sub); }
         } else if (c == 3) {
             char sub[MAX_SUBJECT_NAME];
             read_str("Subject: ", sub, sizeof(sub));
@@ -665,17 +3705,19 @@ void syllabus_menu() {
             char sub[MAX_SUBJECT_NAME], topic[128];
             read_str("Subject: ", sub, sizeof(sub));
             read_str("Topic: ", topic, sizeof(topic));
-            mark_topic_complete(sub, topic);
+            int rc = mark_topic_complete(sub, topic);
+            if (rc == 0) printf("Marked '%s' as completed in %s.\n", topic, sub);
+            else if (rc == -1) { printf("Subject not found.\n"); print_suggestions(&subject_names, sub); }
+            else { printf("Topic not found.\n"); print_suggestions(&topic_names, topic); }
         } else if (c == 5) {
             char sub[MAX_SUBJECT_NAME];
             read_str("Subject: ", sub, sizeof(sub));
             double p = subject_completion_percent(sub);
             printf("Completion for %s: %.2f%%\n", sub, p);
         } else if (c == 6) {
-            Subject* cur = subjects;
-            if (!cur) { printf("No subjects.\n"); continue; }
+            if (!subject_count) { printf("No subjects.\n"); continue; }
             printf("Subjects:\n");
-            while (cur) { printf(" - %s\n", cur->name); cur = cur->next; }
+            for (int i = 0; i < subject_count; ++i) printf(" - %s\n", subject_list[i]->name);
         } else break;
     }
 }
@@ -685,7 +3727,7 @@ void announcements_menu() {
     if (!current_user) { printf("Please login first.\n"); return; }
     while (1) {
         printf("\n--- Announcements Menu ---\n");
-        printf("1. Post announcement (teacher/admin)\n2. View announcements\n3. Back\nChoose: ");
+        printf("1. Post announcement (teacher/admin)\n2. View latest announcements\n3. View new since last check\n4. View since date\n5. Back\nChoose: ");
         int c = read_int();
         if (c < 0) { printf("(No input) Returning to main menu.\n"); break; }
         if (c == 1) {
@@ -695,7 +3737,15 @@ void announcements_menu() {
             push_announcement(text);
             printf("Posted.\n");
         } else if (c == 2) {
-            view_announcements();
+            view_announcements(current_user->id);
+        } else if (c == 3) {
+            view_new_announcements(current_user->id);
+        } else if (c == 4) {
+            printf("Since date (YYYYMMDD): ");
+            int64_t since = date_time(read_int(), 0);
+            if (since < 0) { printf("Invalid date.\n"); continue; }
+            if (!print_announcements_from(ann_seq_since_time(since), 0))
+                printf("No announcements since then.\n");
         } else break;
     }
 }
@@ -705,7 +3755,7 @@ void assignments_menu() {
     if (!current_user) { printf("Please login first.\n"); return; }
     while (1) {
         printf("\n--- Assignments Menu ---\n");
-        printf("1. Create assignment (teacher/admin)\n2. List assignments\n3. Submit assignment (student)\n4. Back\nChoose: ");
+        printf("1. Create assignment (teacher/admin)\n2. List assignments\n3. Submit assignment (student)\n4. Change due date (teacher/admin)\n5. Remove assignment (teacher/admin)\n6. My submissions (student)\n7. Back\nChoose: ");
         int c = read_int();
         if (c < 0) { printf("(No input) Returning to main menu.\n"); break; }
         if (c == 1) {
@@ -717,8 +3767,8 @@ void assignments_menu() {
             printf("Due date (YYYYMMDD): ");
             due = read_int();
             Assignment* a = create_assignment(title, desc, due);
-            heap_push(a);
-            printf("Assignment created.\n");
+            if (heap_push(a) == 0) printf("Assignment created.\n");
+            else { free_assignment(a); printf("Unable to create assignment.\n"); }
         } else if (c == 2) {
             list_assignments();
         } else if (c == 3) {
@@ -728,7 +3778,25 @@ void assignments_menu() {
             printf("Enter assignment ID to submit: ");
             aid = read_int();
             read_str("Enter filename (simulated): ", fname, sizeof(fname));
-            submit_assignment(aid, current_user->id, fname);
+            if (submit_assignment(aid, current_user->id, fname) == 0)
+                printf("Submission recorded for assignment %d by user %d\n", aid, current_user->id);
+            else printf("Assignment with id %d not found.\n", aid);
+        } else if (c == 4) {
+            if (current_user->role == ROLE_STUDENT) { printf("Permission denied.\n"); continue; }
+            printf("Assignment ID: ");
+            int aid = read_int();
+            printf("New due date (YYYYMMDD): ");
+            int due = read_int();
+            if (heap_update_due(aid, due) == 0) printf("Due date updated.\n");
+            else printf("Assignment with id %d not found.\n", aid);
+        } else if (c == 5) {
+            if (current_user->role == ROLE_STUDENT) { printf("Permission denied.\n"); continue; }
+            printf("Assignment ID: ");
+            int aid = read_int();
+            if (heap_remove(aid) == 0) printf("Assignment removed.\n");
+            else printf("Assignment with id %d not found.\n", aid);
+        } else if (c == 6) {
+            list_student_submissions(current_user->id);
         } else break;
     }
 }
@@ -738,12 +3806,17 @@ void admin_menu() {
     if (!current_user || current_user->role != ROLE_ADMIN) { printf("Admin only.\n"); return; }
     while (1) {
         printf("\n--- Admin Menu ---\n");
-        printf("1. List users\n2. Save users to file\n3. Load users from file\n4. Syllabus report\n5. Back\nChoose: ");
+        printf("1. List users\n2. Save users to file\n3. Load users from file\n4. Syllabus report\n5. Checkpoint now\n6. Memory usage\n7. Back\nChoose: ");
         int c = read_int();
         if (c == 1) list_users();
         else if (c == 2) { char fn[128]; read_str("Filename: ", fn, sizeof(fn)); save_users_to_file(fn); }
         else if (c == 3) { char fn[128]; read_str("Filename: ", fn, sizeof(fn)); load_users_from_file(fn); }
         else if (c == 4) syllabus_report();
+        else if (c == 5) {
+            if (checkpoint(1) == 0) printf("Checkpoint to %s started.\n", SNAPSHOT_FILE);
+            else printf("Unable to start checkpoint.\n");
+        }
+        else if (c == 6) print_mem_stats(stdout);
         else break;
     }
 }
@@ -768,16 +3841,898 @@ void main_menu() {
     }
 }
 
+/* =========================
+   Command protocol - shared by batch mode and server mode
+   One command per line, tab-separated fields, '#' starts a comment. Every
+   command answers with exactly one line:
+       ok[\t<result>]            or   err\t<line number>\t<reason>
+   `read` and `new` first print one `msg\t<ts>\t<sender>\t<text>` line per
+   message.
+   Commands act as the session's user, set by `login`:
+       user <name> <password> <student|teacher|admin>   -> ok <id>
+           (over the server socket, teacher and admin need an admin session)
+       login <name> <password>                          -> ok <id>
+       logout
+       send <peer> <text>
+       read <peer> [<before seq> [<limit>]]             -> ok <count> <older cursor or -1>
+           (the newest page also marks the conversation read)
+       new <peer> [<limit>]                             -> ok <count> <still unread>
+       unread                                           -> ok <total unread>
+           preceded by `peer\t<name>\t<unread>` for each peer with unread messages
+       announce <text>
+       subject <name>
+       topic <subject> <topic>
+       complete <subject> <topic>
+       progress <subject>                               -> ok <topics> <completed>
+       assign <due YYYYMMDD> <title> [<description>]    -> ok <id>
+       due <assignment id> <due YYYYMMDD>
+       unassign <assignment id>
+       submit <assignment id> <filename>
+       next                                             -> ok <id> <due> <title>
+       suggest <user|subject|topic> <prefix> [<k>]      -> ok <count>
+           preceded by `match\t<name>` lines (topics: `match\t<topic>\t<subject>`)
+       search <query> [<sender> [<from ts> [<to ts>]]]  -> ok <count>
+           preceded by `hit\t<ts>\t<sender>\t<peer>\t<text>` lines, newest
+           first; announcements have empty sender and peer
+       stats                                            -> ok <live bytes>
+           admin only; preceded by
+           `pool\t<name>\t<bytes>\t<peak>\t<objects>\t<mallocs>` lines
+       checkpoint                                       admin only
+   Each command takes the subsystem locks it needs itself, so sessions on
+   different threads can run commands concurrently.
+   ========================= */
+
+#define CMD_MAX_FIELDS 5
+#define SUGGEST_LIMIT 50 // most matches one `suggest` returns
+
+typedef struct Session {
+    User* user; // logged-in user, NULL before `login`
+    int remote; // a server connection rather than a local batch script
+} Session;
+
+pthread_mutex_t checkpoint_lock = PTHREAD_MUTEX_INITIALIZER; // one checkpoint at a time
+
+/* Checkpoint from a session: stop all commands while the child is forked. */
+int session_checkpoint(void) {
+    pthread_mutex_lock(&checkpoint_lock);
+    state_quiesce_begin();
+    int rc = checkpoint(1);
+    state_quiesce_end();
+    pthread_mutex_unlock(&checkpoint_lock);
+    return rc;
+}
+
+static int cmd_int(const char* s, long* out) {
+    char* end;
+    errno = 0;
+    *out = strtol(s, &end, 10);
+    return *s && !*end && !errno && *out >= INT32_MIN && *out <= INT32_MAX ? 0 : -1;
+}
+
+static void cmd_text(char* s, size_t max) {
+    if (strlen(s) >= max) s[max - 1] = '\0';
+}
+
+static User* cmd_find_user(const char* name) {
+    pthread_rwlock_rdlock(&users_lock);
+    User* u = find_user_by_name(name); // records are never freed or moved
+    pthread_rwlock_unlock(&users_lock);
+    return u;
+}
+
+static void cmd_print_messages(FILE* out, const MsgRecord** page, int n) {
+    const char* sender[MSG_PAGE_SIZE];
+    pthread_rwlock_rdlock(&users_lock);
+    for (int i = 0; i < n; ++i) {
+        User* u = find_user_by_id(page[i]->sender_id);
+        sender[i] = u ? u->username : "";
+    }
+    pthread_rwlock_unlock(&users_lock);
+    for (int i = 0; i < n; ++i)
+        fprintf(out, "msg\t%lld\t%s\t%s\n", (long long)page[i]->ts, sender[i], page[i]->text);
+}
+
+/* Run one command; returns NULL on success or the error reason. */
+static const char* session_exec(Session* ss, FILE* out, char** f, int n) {
+    const char* cmd = f[0];
+    long a = 0, b = 0;
+    #define NEED(lo, hi) do { if (n < (lo) || n > (hi)) return "wrong number of fields"; } while (0)
+    #define LOGGED() do { if (!ss->user) return "not logged in"; } while (0)
+    #define STAFF() do { LOGGED(); if (ss->user->role == ROLE_STUDENT) return "permission denied"; } while (0)
+
+    if (strcmp(cmd, "user") == 0) {
+        NEED(4, 4);
+        if (!*f[1] || strlen(f[1]) >= MAX_NAME || strlen(f[2]) >= MAX_NAME) return "bad name or password";
+        Role r;
+        if (strcmp(f[3], "student") == 0) r = ROLE_STUDENT;
+        else if (strcmp(f[3], "teacher") == 0) r = ROLE_TEACHER;
+        else if (strcmp(f[3], "admin") == 0) r = ROLE_ADMIN;
+        else return "unknown role";
+        // anyone who can reach the socket may sign up, but only as a student
+        if (ss->remote && r != ROLE_STUDENT && (!ss->user || ss->user->role != ROLE_ADMIN)) return "permission denied";
+        unsigned char d[DIGEST_LEN];
+        password_digest(f[1], f[2], d); // hash outside the lock
+        pthread_rwlock_wrlock(&users_lock);
+        User* u = insert_user_record(next_user_id, f[1], d, r);
+        int exists = !u && find_user_by_name(f[1]);
+        pthread_rwlock_unlock(&users_lock);
+        if (!u) return exists ? "user exists" : "unable to create user";
+        fprintf(out, "ok\t%d\n", u->id);
+    } else if (strcmp(cmd, "login") == 0) {
+        NEED(3, 3);
+        User* u = cmd_find_user(f[1]);
+        if (!u || !user_check_password(u, f[2])) return "invalid credentials";
+        ss->user = u;
+        fprintf(out, "ok\t%d\n", u->id);
+    } else if (strcmp(cmd, "logout") == 0) {
+        NEED(1, 1);
+        ss->user = NULL;
+        fprintf(out, "ok\n");
+    } else if (strcmp(cmd, "send") == 0) {
+        NEED(3, 3); LOGGED();
+        User* p = cmd_find_user(f[1]);
+        if (!p) return "user not found";
+        cmd_text(f[2], MAX_TEXT);
+        send_message(ss->user->id, p->id, f[2]);
+        fprintf(out, "ok\n");
+    } else if (strcmp(cmd, "read") == 0) {
+        NEED(2, 4); LOGGED();
+        User* p = cmd_find_user(f[1]);
+        if (!p) return "user not found";
+        a = -1; b = MSG_PAGE_SIZE;
+        if (n > 2 && cmd_int(f[2], &a) != 0) return "bad cursor";
+        if (n > 3 && (cmd_int(f[3], &b) != 0 || b <= 0)) return "bad limit";
+        if (b > MSG_PAGE_SIZE) b = MSG_PAGE_SIZE;
+        const MsgRecord* page[MSG_PAGE_SIZE];
+        long older = -1;
+        int cnt = chat_read_page(ss->user->id, p->id, a, (int)b, page, &older);
+        cmd_print_messages(out, page, cnt);
+        fprintf(out, "ok\t%d\t%ld\n", cnt, older);
+    } else if (strcmp(cmd, "new") == 0) {
+        NEED(2, 3); LOGGED();
+        User* p = cmd_find_user(f[1]);
+        if (!p) return "user not found";
+        b = MSG_PAGE_SIZE;
+        if (n > 2 && (cmd_int(f[2], &b) != 0 || b <= 0)) return "bad limit";
+        if (b > MSG_PAGE_SIZE) b = MSG_PAGE_SIZE;
+        const MsgRecord* page[MSG_PAGE_SIZE];
+        int cnt = chat_read_new(ss->user->id, p->id, (int)b, page, &a);
+        cmd_print_messages(out, page, cnt);
+        fprintf(out, "ok\t%d\t%ld\n", cnt, a);
+    } else if (strcmp(cmd, "unread") == 0) {
+        NEED(1, 1); LOGGED();
+        ChatUnread* peers;
+        int cnt = chat_unread_counts(ss->user->id, &peers);
+        long total = 0;
+        pthread_rwlock_rdlock(&users_lock);
+        for (int i = 0; i < cnt; ++i) {
+            User* u = find_user_by_id(peers[i].peer_id);
+            if (peers[i].unread && u) fprintf(out, "peer\t%s\t%ld\n", u->username, peers[i].unread);
+            total += peers[i].unread;
+        }
+        pthread_rwlock_unlock(&users_lock);
+        free(peers);
+        fprintf(out, "ok\t%ld\n", total);
+    } else if (strcmp(cmd, "announce") == 0) {
+        NEED(2, 2); STAFF();
+        cmd_text(f[1], MAX_TEXT);
+        pthread_rwlock_wrlock(&ann_lock);
+        push_announcement(f[1]);
+        pthread_rwlock_unlock(&ann_lock);
+        fprintf(out, "ok\n");
+    } else if (strcmp(cmd, "subject") == 0) {
+        NEED(2, 2); STAFF();
+        if (!*f[1]) return "empty name";
+        pthread_rwlock_wrlock(&syllabus_lock);
+        int rc = create_subject(f[1]);
+        pthread_rwlock_unlock(&syllabus_lock);
+        if (rc != 0) return "subject exists";
+        fprintf(out, "ok\n");
+    } else if (strcmp(cmd, "topic") == 0) {
+        NEED(3, 3); STAFF();
+        cmd_text(f[2], sizeof(((Topic*)0)->name));
+        pthread_rwlock_wrlock(&syllabus_lock);
+        int rc = add_topic_to_subject(f[1], f[2]);
+        pthread_rwlock_unlock(&syllabus_lock);
+        if (rc != 0) return "subject not found";
+        fprintf(out, "ok\n");
+    } else if (strcmp(cmd, "complete") == 0) {
+        NEED(3, 3); STAFF();
+        pthread_rwlock_wrlock(&syllabus_lock);
+        int rc = mark_topic_complete(f[1], f[2]);
+        pthread_rwlock_unlock(&syllabus_lock);
+        if (rc == -1) return "subject not found";
+        if (rc == -2) return "topic not found";
+        fprintf(out, "ok\n");
+    } else if (strcmp(cmd, "progress") == 0) {
+        NEED(2, 2); LOGGED();
+        pthread_rwlock_rdlock(&syllabus_lock);
+        Subject* sj = find_subject(f[1]);
+        if (sj) { a = sj->topics; b = sj->completed; }
+        pthread_rwlock_unlock(&syllabus_lock);
+        if (!sj) return "subject not found";
+        fprintf(out, "ok\t%ld\t%ld\n", a, b);
+    } else if (strcmp(cmd, "assign") == 0) {
+        NEED(3, 4); STAFF();
+        if (cmd_int(f[1], &a) != 0) return "bad due date";
+        pthread_rwlock_wrlock(&assign_lock);
+        Assignment* as = create_assignment(f[2], n > 3 ? f[3] : "", (int)a);
+        int id = as->id;
+        if (heap_push(as) != 0) { free_assignment(as); id = 0; }
+        pthread_rwlock_unlock(&assign_lock);
+        if (!id) return "unable to create assignment";
+        fprintf(out, "ok\t%d\n", id);
+    } else if (strcmp(cmd, "due") == 0) {
+        NEED(3, 3); STAFF();
+        if (cmd_int(f[1], &a) != 0 || cmd_int(f[2], &b) != 0) return "bad number";
+        pthread_rwlock_wrlock(&assign_lock);
+        int rc = heap_update_due((int)a, (int)b);
+        pthread_rwlock_unlock(&assign_lock);
+        if (rc != 0) return "assignment not found";
+        fprintf(out, "ok\n");
+    } else if (strcmp(cmd, "unassign") == 0) {
+        NEED(2, 2); STAFF();
+        if (cmd_int(f[1], &a) != 0) return "bad number";
+        pthread_rwlock_wrlock(&assign_lock);
+        int rc = heap_remove((int)a);
+        pthread_rwlock_unlock(&assign_lock);
+        if (rc != 0) return "assignment not found";
+        fprintf(out, "ok\n");
+    } else if (strcmp(cmd, "submit") == 0) {
+        NEED(3, 3); LOGGED();
+        if (ss->user->role != ROLE_STUDENT) return "only students can submit";
+        if (cmd_int(f[1], &a) != 0) return "bad number";
+        pthread_rwlock_wrlock(&assign_lock);
+        pthread_rwlock_rdlock(&users_lock); // the record caches the student's name
+        int rc = submit_assignment((int)a, ss->user->id, f[2]);
+        pthread_rwlock_unlock(&users_lock);
+        pthread_rwlock_unlock(&assign_lock);
+        if (rc != 0) return "assignment not found";
+        fprintf(out, "ok\n");
+    } else if (strcmp(cmd, "next") == 0) {
+        NEED(1, 1); LOGGED();
+        char title[sizeof(((Assignment*)0)->title)];
+        pthread_rwlock_rdlock(&assign_lock);
+        Assignment* as = peek_min_assignment();
+        if (as) { a = as->id; b = as->dueDate; strcpy(title, as->title); }
+        pthread_rwlock_unlock(&assign_lock);
+        if (!as) return "no assignments";
+        fprintf(out, "ok\t%ld\t%ld\t%s\n", a, b, title);
+    } else if (strcmp(cmd, "suggest") == 0) {
+        NEED(3, 4); LOGGED();
+        RadixMatch m[SUGGEST_LIMIT];
+        const char* subj[SUGGEST_LIMIT];
+        b = 10;
+        if (n > 3 && (cmd_int(f[3], &b) != 0 || b <= 0)) return "bad count";
+        if (b > SUGGEST_LIMIT) b = SUGGEST_LIMIT;
+        int cnt, topics = strcmp(f[1], "topic") == 0;
+        if (strcmp(f[1], "user") == 0) {
+            pthread_rwlock_rdlock(&users_lock);
+            cnt = radix_prefix(&user_names, f[2], m, (int)b);
+            pthread_rwlock_unlock(&users_lock);
+        } else if (topics || strcmp(f[1], "subject") == 0) {
+            pthread_rwlock_rdlock(&syllabus_lock);
+            cnt = radix_prefix(topics ? &topic_names : &subject_names, f[2], m, (int)b);
+            for (int i = 0; topics && i < cnt; ++i) subj[i] = subject_list[m[i].value - 1]->name;
+            pthread_rwlock_unlock(&syllabus_lock);
+        } else return "unknown index";
+        for (int i = 0; i < cnt; ++i) {
+            if (topics) fprintf(out, "match\t%s\t%s\n", m[i].key, subj[i]);
+            else fprintf(out, "match\t%s\n", m[i].key);
+        }
+        fprintf(out, "ok\t%d\n", cnt);
+    } else if (strcmp(cmd, "search") == 0) {
+        NEED(2, 5); LOGGED();
+        int sender_id = 0;
+        if (n > 2 && *f[2]) {
+            User* s = cmd_find_user(f[2]);
+            if (!s) return "user not found";
+            sender_id = s->id;
+        }
+        if ((n > 3 && *f[3] && cmd_int(f[3], &a) != 0) || (n > 4 && *f[4] && cmd_int(f[4], &b) != 0))
+            return "bad time";
+        SearchHit hits[SEARCH_MAX_HITS];
+        int cnt = search_messages(ss->user->id, f[1], sender_id, a, b, hits, SEARCH_MAX_HITS);
+        if (cnt < 0) return "empty query";
+        for (int i = 0; i < cnt; ++i)
+            fprintf(out, "hit\t%lld\t%s\t%s\t%s\n", (long long)hits[i].ts, hits[i].sender, hits[i].peer, hits[i].text);
+        fprintf(out, "ok\t%d\n", cnt);
+    } else if (strcmp(cmd, "stats") == 0) {
+        NEED(1, 1); LOGGED();
+        if (ss->user->role != ROLE_ADMIN) return "permission denied";
+        size_t total = 0;
+        for (int i = 0; i < MEM_POOLS; ++i) {
+            const MemPool* p = &mem_pools[i];
+            size_t bytes = __atomic_load_n(&p->bytes, __ATOMIC_RELAXED);
+            fprintf(out, "pool\t%s\t%zu\t%zu\t%zu\t%zu\n", p->name, bytes, __atomic_load_n(&p->peak, __ATOMIC_RELAXED),
+                    __atomic_load_n(&p->objects, __ATOMIC_RELAXED), __atomic_load_n(&p->calls, __ATOMIC_RELAXED));
+            total += bytes;
+        }
+        fprintf(out, "ok\t%zu\n", total);
+    } else return "unknown command";
+    return NULL;
+    #undef NEED
+    #undef LOGGED
+    #undef STAFF
+}
+
+/* Parse and run one input line. Returns 1 if it was a command that
+   succeeded, 0 if it failed, -1 for blank lines and comments. */
+int session_line(Session* ss, FILE* out, char* line, long lineno) {
+    if (!*line || line[0] == '#') return -1;
+    char* f[CMD_MAX_FIELDS];
+    int n = split_fields(line, '\t', f, CMD_MAX_FIELDS);
+    const char* err;
+    if (n > CMD_MAX_FIELDS) err = "too many fields";
+    else if (strcmp(f[0], "checkpoint") == 0) { // must not run inside state_enter
+        if (n != 1) err = "wrong number of fields";
+        else if (!ss->user) err = "not logged in";
+        else if (ss->user->role != ROLE_ADMIN) err = "permission denied"; // it forks and writes the whole state
+        else err = session_checkpoint() != 0 ? "checkpoint failed" : NULL;
+        if (!err) fprintf(out, "ok\n");
+    } else {
+        state_enter();
+        err = session_exec(ss, out, f, n);
+        state_leave();
+    }
+    if (err) fprintf(out, "err\t%ld\t%s\n", lineno, err);
+    return err ? 0 : 1;
+}
+
+/* =========================
+   Batch mode - `classroom --batch [file]`
+   Runs a command script from the file or stdin on the calling thread,
+   with no prompts. Output goes to stdout, block-buffered, and is flushed
+   right after each WAL sync (every BATCH_COMMIT_LINES commands and at the
+   end), not once per line.
+   ========================= */
+
+#define BATCH_COMMIT_LINES 4096 // sync the WAL and flush output this often
+#define BATCH_OUT_BUFFER (1 << 20)
+
+/* Commit what has been applied so far, then let the answers out. */
+static void batch_commit(void) {
+    wal_commit_point();
+    fflush(stdout);
+}
+
+int run_batch(const char* path) {
+    FILE* in = stdin;
+    if (path && strcmp(path, "-") != 0) {
+        in = fopen(path, "r");
+        if (!in) { fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno)); return 1; }
+    }
+    static char outbuf[BATCH_OUT_BUFFER];
+    setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    Session ss = { NULL, 0 };
+    char* line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    long lineno = 0, ok = 0, failed = 0;
+    while ((len = getline(&line, &cap, in)) >= 0) {
+        ++lineno;
+        while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) line[--len] = '\0';
+        int rc = session_line(&ss, stdout, line, lineno);
+        if (rc > 0) ok++;
+        else if (rc == 0) failed++;
+        if (lineno % BATCH_COMMIT_LINES == 0) batch_commit();
+    }
+    batch_commit();
+    free(line);
+    if (in != stdin) fclose(in);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (double)(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    fprintf(stderr, "batch: %ld ok, %ld failed in %.3f s (%.0f ops/s)\n",
+            ok, failed, secs, secs > 0 ? (ok + failed) / secs : 0.0);
+    return failed ? 2 : 0;
+}
+
+/* =========================
+   Server mode - `classroom --serve [socket] [workers]`
+   Listens on a Unix domain socket. The main thread accepts connections
+   into a bounded queue and runs checkpoints; a fixed pool of workers each
+   serves one connection at a time with its own Session, speaking the
+   command protocol above. A worker runs every complete line it has read,
+   then commits the WAL up to the latest LSN before sending the replies.
+   Workers committing at the same time share one fsync.
+   SIGINT/SIGTERM close the listener, shut down open connections and write
+   a final snapshot.
+   ========================= */
+
+#define SERVER_SOCKET "classroom.sock"
+#define SERVER_WORKERS 16
+#define SERVER_MAX_WORKERS 256
+#define SERVER_QUEUE 128 // accepted connections waiting for a worker
+#define SERVER_READ_BUF 65536
+
+typedef struct ConnQueue {
+    int fds[SERVER_QUEUE];
+    int head, count;
+    int closing;
+    int active[SERVER_MAX_WORKERS]; // fd each worker is serving, -1 when idle
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+} ConnQueue;
+
+static ConnQueue conn_queue = { .lock = PTHREAD_MUTEX_INITIALIZER, .ready = PTHREAD_COND_INITIALIZER };
+static int server_stop = 0; // set from the signal handler
+
+static void server_signal(int sig) { (void)sig; __atomic_store_n(&server_stop, 1, __ATOMIC_RELAXED); }
+
+static int conn_push(int fd) {
+    pthread_mutex_lock(&conn_queue.lock);
+    int ok = conn_queue.count < SERVER_QUEUE;
+    if (ok) {
+        conn_queue.fds[(conn_queue.head + conn_queue.count++) % SERVER_QUEUE] = fd;
+        pthread_cond_signal(&conn_queue.ready);
+    }
+    pthread_mutex_unlock(&conn_queue.lock);
+    return ok ? 0 : -1;
+}
+
+/* Next connection for worker `slot`, or -1 once the server is closing. */
+static int conn_pop(int slot) {
+    pthread_mutex_lock(&conn_queue.lock);
+    while (!conn_queue.count && !conn_queue.closing) pthread_cond_wait(&conn_queue.ready, &conn_queue.lock);
+    int fd = -1;
+    if (!conn_queue.closing) {
+        fd = conn_queue.fds[conn_queue.head];
+        conn_queue.head = (conn_queue.head + 1) % SERVER_QUEUE;
+        conn_queue.count--;
+    }
+    conn_queue.active[slot] = fd;
+    pthread_mutex_unlock(&conn_queue.lock);
+    return fd;
+}
+
+static void conn_done(int slot) {
+    pthread_mutex_lock(&conn_queue.lock);
+    int fd = conn_queue.active[slot];
+    conn_queue.active[slot] = -1;
+    pthread_mutex_unlock(&conn_queue.lock);
+    close(fd);
+}
+
+static void serve_connection(int fd, char* buf) {
+    int wfd = dup(fd);
+    FILE* out = wfd >= 0 ? fdopen(wfd, "w") : NULL;
+    if (!out) { if (wfd >= 0) close(wfd); return; }
+    setvbuf(out, NULL, _IOFBF, SERVER_READ_BUF);
+    Session ss = { NULL, 1 };
+    size_t len = 0;
+    long lineno = 0;
+    int discarding = 0; // inside a line longer than the buffer
+    while (1) {
+        ssize_t r = read(fd, buf + len, SERVER_READ_BUF - 1 - len);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        len += (size_t)r;
+        char* p = buf;
+        char* nl;
+        while ((nl = memchr(p, '\n', len - (size_t)(p - buf))) != NULL) {
+            *nl = '\0';
+            if (nl > p && nl[-1] == '\r') nl[-1] = '\0';
+            ++lineno;
+            if (discarding) { fprintf(out, "err\t%ld\tline too long\n", lineno); discarding = 0; }
+            else session_line(&ss, out, p, lineno);
+            p = nl + 1;
+        }
+        len -= (size_t)(p - buf);
+        memmove(buf, p, len);
+        if (len == SERVER_READ_BUF - 1) { discarding = 1; len = 0; }
+        wal_commit_upto(wal_current_lsn());
+        if (fflush(out) != 0) break;
+    }
+    fclose(out);
+}
+
+static void* server_worker(void* arg) {
+    int slot = (int)(intptr_t)arg;
+    char* buf = (char*)malloc(SERVER_READ_BUF);
+    int fd;
+    while (buf && (fd = conn_pop(slot)) >= 0) {
+        serve_connection(fd, buf);
+        conn_done(slot);
+    }
+    free(buf);
+    return NULL;
+}
+
+/* Reap finished checkpoints and start one when the log has grown. */
+static void server_maintain(void) {
+    pthread_mutex_lock(&checkpoint_lock);
+    checkpoint_poll(0);
+    pthread_mutex_lock(&wal_lock);
+    int due = wal_fd >= 0 && wal_seg_bytes >= WAL_CHECKPOINT_BYTES;
+    pthread_mutex_unlock(&wal_lock);
+    if (due && checkpoint_pid < 0) {
+        state_quiesce_begin();
+        checkpoint(1);
+        state_quiesce_end();
+    }
+    pthread_mutex_unlock(&checkpoint_lock);
+}
+
+int run_server(const char* path, int workers) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) { fprintf(stderr, "Socket path too long: %s\n", path); return 1; }
+    strcpy(addr.sun_path, path);
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0) { perror("socket"); return 1; }
+    unlink(path); // stale socket from an earlier run
+    // owner only, set before listen so no one can connect in between
+    if (bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || chmod(path, 0600) != 0
+        || listen(lfd, SERVER_QUEUE) != 0) {
+        perror(path);
+        close(lfd);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = server_signal; // no SA_RESTART: poll returns EINTR
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN); // clients may hang up mid-reply
+
+    pthread_t tids[SERVER_MAX_WORKERS];
+    for (int i = 0; i < SERVER_MAX_WORKERS; ++i) conn_queue.active[i] = -1;
+    int started = 0;
+    while (started < workers && pthread_create(&tids[started], NULL, server_worker, (void*)(intptr_t)started) == 0)
+        started++;
+    if (!started) { fprintf(stderr, "Unable to start workers.\n"); close(lfd); unlink(path); return 1; }
+    fprintf(stderr, "Listening on %s with %d workers.\n", path, started);
+
+    while (!__atomic_load_n(&server_stop, __ATOMIC_RELAXED)) {
+        struct pollfd pfd = { lfd, POLLIN, 0 };
+        if (poll(&pfd, 1, 100) > 0) {
+            int fd = accept(lfd, NULL, NULL);
+            if (fd >= 0 && conn_push(fd) != 0) {
+                static const char busy[] = "err\t0\tserver busy\n";
+                if (write(fd, busy, sizeof(busy) - 1) < 0) { /* the client is gone anyway */ }
+                close(fd);
+            }
+        }
+        server_maintain();
+    }
+
+    close(lfd);
+    unlink(path);
+    pthread_mutex_lock(&conn_queue.lock);
+    conn_queue.closing = 1;
+    for (int i = 0; i < started; ++i)
+        if (conn_queue.active[i] >= 0) shutdown(conn_queue.active[i], SHUT_RDWR);
+    for (; conn_queue.count; conn_queue.count--, conn_queue.head = (conn_queue.head + 1) % SERVER_QUEUE)
+        close(conn_queue.fds[conn_queue.head]);
+    pthread_cond_broadcast(&conn_queue.ready);
+    pthread_mutex_unlock(&conn_queue.lock);
+    for (int i = 0; i < started; ++i) pthread_join(tids[i], NULL);
+    fprintf(stderr, "Server stopped.\n");
+    return 0;
+}
+
+/* =========================
+   Benchmark - `classroom --bench [users] [ops] [subjects]`
+   Builds a classroom from scratch in memory (no snapshot, no WAL), then
+   runs a mixed workload where chat senders and recipients are drawn from
+   a Zipf(1) distribution over the users, so a few users are very busy and
+   most are quiet. Every operation is timed on its own; the report gives
+   throughput and p50/p99/p999 latency per operation. Output of the
+   listing operations is sent to /dev/null while they are timed. Messages
+   mention course words, and every 100th operation is a two-word search
+   (every other one a phrase) by a Zipf-drawn user.
+   A final phase has BENCH_FANIN_THREADS threads message the busiest user
+   at the same time, to show how mailbox delivery holds up under fan-in.
+   ========================= */
+
+#define BENCH_FANIN_THREADS 8
+
+enum { B_CREATE_USER, B_FIND_USER, B_SEND, B_VIEW, B_BST_INSERT, B_HEAP_PUSH, B_HEAP_POP,
+       B_SUBMIT, B_LIST_ASSIGNMENTS, B_SEARCH, B_SEND_FANIN, B_OPS };
+
+static const char* bench_names[B_OPS] = {
+    "create_user", "find_user_by_name", "send_message", "view_messages_between", "bst_insert",
+    "heap_push", "heap_pop", "submit_assignment", "list_assignments", "search_messages",
+    "send_message fan-in"
+};
+
+static const char* bench_words[] = {
+    "array", "list", "stack", "queue", "heap", "tree", "graph", "hash", "sort", "search",
+    "exam", "lab", "deadline", "recursion", "pointer", "memory", "complexity", "proof",
+    "lecture", "notes", "question", "answer", "bug", "test", "trie", "avl", "bfs", "dfs",
+    "dijkstra", "matrix", "string", "bits"
+};
+#define BENCH_WORDS (sizeof(bench_words) / sizeof(bench_words[0]))
+
+typedef struct BenchSamples {
+    uint64_t* ns;
+    size_t count, cap;
+    uint64_t total;
+} BenchSamples;
+
+static BenchSamples bench_samples[B_OPS];
+static uint64_t bench_rng = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t bench_rand(void) { // xorshift64*
+    bench_rng ^= bench_rng >> 12; bench_rng ^= bench_rng << 25; bench_rng ^= bench_rng >> 27;
+    return bench_rng * 0x2545F4914F6CDD1DULL;
+}
+
+static uint64_t bench_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + (uint64_t)t.tv_nsec;
+}
+
+static void bench_add(BenchSamples* b, uint64_t start) {
+    uint64_t d = bench_now() - start;
+    if (b->count == b->cap) {
+        b->cap = b->cap ? b->cap * 2 : 1024;
+        b->ns = (uint64_t*)realloc(b->ns, b->cap * sizeof(uint64_t));
+    }
+    b->ns[b->count++] = d;
+    b->total += d;
+}
+
+static void bench_record(int op, uint64_t start) { bench_add(&bench_samples[op], start); }
+
+typedef struct BenchFanin {
+    int from, to;
+    long count;
+    BenchSamples samples;
+} BenchFanin;
+
+static void* bench_fanin_thread(void* arg) {
+    BenchFanin* w = (BenchFanin*)arg;
+    char text[64];
+    for (long i = 0; i < w->count; ++i) {
+        snprintf(text, sizeof(text), "fan-in %ld", i);
+        uint64_t t = bench_now();
+        send_message(w->from, w->to, text);
+        bench_add(&w->samples, t);
+    }
+    return NULL;
+}
+
+/* Zipf(1) over ranks 0..n-1 by inverting a precomputed CDF. */
+static double* bench_zipf_cdf = NULL;
+static int bench_zipf_n = 0;
+
+static void bench_zipf_init(int n) {
+    bench_zipf_cdf = (double*)malloc((size_t)n * sizeof(double));
+    double sum = 0;
+    for (int k = 0; k < n; ++k) bench_zipf_cdf[k] = (sum += 1.0 / (k + 1));
+    for (int k = 0; k < n; ++k) bench_zipf_cdf[k] /= sum;
+    bench_zipf_n = n;
+}
+
+static int bench_zipf(void) {
+    double u = (double)(bench_rand() >> 11) / 9007199254740992.0; // [0, 1)
+    int lo = 0, hi = bench_zipf_n - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (bench_zipf_cdf[mid] < u) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static int bench_cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double bench_pct(const BenchSamples* b, double p) {
+    size_t i = (size_t)(p * (double)(b->count - 1) + 0.5);
+    return (double)b->ns[i] / 1000.0;
+}
+
+int run_bench(int nusers, long nops, int nsubjects) {
+    char name[MAX_NAME], text[MAX_TEXT];
+    int* ids = (int*)malloc((size_t)nusers * sizeof(int));
+    int* names = (int*)malloc((size_t)nusers * sizeof(int)); // rank -> user number, shuffled
+    int devnull = open("/dev/null", O_WRONLY);
+    int saved_stdout = dup(STDOUT_FILENO);
+    if (!ids || !names || devnull < 0 || saved_stdout < 0) { fprintf(stderr, "bench: setup failed\n"); return 1; }
+    printf("Benchmark: %d users, %ld ops, %d subjects\n", nusers, nops, nsubjects);
+    fflush(stdout);
+    uint64_t wall = bench_now();
+
+    for (int i = 0; i < nusers; ++i) {
+        snprintf(name, sizeof(name), "user%d", i);
+        uint64_t t = bench_now();
+        User* u = create_user(name, "password", i % 20 ? ROLE_STUDENT : ROLE_TEACHER);
+        bench_record(B_CREATE_USER, t);
+        ids[i] = u ? u->id : 0;
+        names[i] = i;
+    }
+    for (int i = nusers - 1; i > 0; --i) { // hot users are spread over the id range
+        int j = (int)(bench_rand() % (uint64_t)(i + 1));
+        int tmp = names[i]; names[i] = names[j]; names[j] = tmp;
+    }
+    bench_zipf_init(nusers);
+
+    for (int s = 0; s < nsubjects; ++s) {
+        snprintf(name, sizeof(name), "Subject %d", s);
+        create_subject(name);
+        Subject* sj = find_subject(name);
+        for (int k = 0; k < 200; ++k) {
+            snprintf(text, sizeof(text), "Topic %05d", (int)(bench_rand() % 100000));
+            uint64_t t = bench_now();
+            sj->root = bst_insert(sj->root, text);
+            bench_record(B_BST_INSERT, t);
+        }
+        sj->topics = topic_count(sj->root);
+    }
+
+    dup2(devnull, STDOUT_FILENO);
+    for (long op = 0; op < nops; ++op) {
+        unsigned r = (unsigned)(bench_rand() % 100);
+        int a = names[bench_zipf()], b = names[bench_zipf()];
+        if (a == b) b = (b + 1) % nusers;
+        uint64_t t = bench_now();
+        if (r < 50) {
+            snprintf(text, sizeof(text), "message %ld from user%d about %s and %s", op, a,
+                     bench_words[bench_rand() % BENCH_WORDS], bench_words[bench_rand() % BENCH_WORDS]);
+            t = bench_now();
+            send_message(ids[a], ids[b], text);
+            bench_record(B_SEND, t);
+        } else if (r < 75) {
+            snprintf(name, sizeof(name), "user%d", a);
+            t = bench_now();
+            find_user_by_name(name);
+            bench_record(B_FIND_USER, t);
+        } else if (r < 87) {
+            view_messages_between(ids[a], ids[b], -1, MSG_PAGE_SIZE);
+            bench_record(B_VIEW, t);
+        } else if (r < 92) {
+            if (heap_size) {
+                Assignment* as = assignment_heap[bench_rand() % (uint64_t)heap_size];
+                t = bench_now();
+                submit_assignment(as->id, ids[a], "solution.c");
+                bench_record(B_SUBMIT, t);
+            }
+        } else if (r < 97) {
+            Assignment* as = create_assignment("Bench assignment", "Generated",
+                                               20250101 + (int)(bench_rand() % 12) * 100 + (int)(bench_rand() % 28));
+            t = bench_now();
+            if (heap_push(as) != 0) free_assignment(as);
+            bench_record(B_HEAP_PUSH, t);
+        } else if (heap_size) {
+            Assignment* as = heap_pop();
+            bench_record(B_HEAP_POP, t);
+            free_assignment(as);
+        }
+        if (op % 1000 == 999) {
+            t = bench_now();
+            list_assignments();
+            bench_record(B_LIST_ASSIGNMENTS, t);
+        }
+        if (op % 100 == 99) {
+            SearchHit hits[SEARCH_MAX_HITS];
+            snprintf(text, sizeof(text), op % 200 == 199 ? "\"%s and %s\"" : "%s %s",
+                     bench_words[bench_rand() % BENCH_WORDS], bench_words[bench_rand() % BENCH_WORDS]);
+            t = bench_now();
+            search_messages(ids[a], text, 0, 0, 0, hits, SEARCH_MAX_HITS);
+            bench_record(B_SEARCH, t);
+        }
+    }
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    close(devnull);
+
+    BenchFanin fan[BENCH_FANIN_THREADS];
+    pthread_t tids[BENCH_FANIN_THREADS];
+    int hot = ids[names[0]], threads = 0;
+    uint64_t fan_wall = bench_now();
+    for (int i = 0; i < BENCH_FANIN_THREADS && i + 1 < nusers; ++i) {
+        memset(&fan[i], 0, sizeof(fan[i]));
+        fan[i].from = ids[names[i + 1]];
+        fan[i].to = hot;
+        fan[i].count = nops / 4 / BENCH_FANIN_THREADS;
+        if (pthread_create(&tids[i], NULL, bench_fanin_thread, &fan[i]) != 0) break;
+        threads++;
+    }
+    long fan_msgs = 0;
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(tids[i], NULL);
+        BenchSamples* b = &bench_samples[B_SEND_FANIN];
+        for (size_t k = 0; k < fan[i].samples.count; ++k) {
+            if (b->count == b->cap) {
+                b->cap = b->cap ? b->cap * 2 : 1024;
+                b->ns = (uint64_t*)realloc(b->ns, b->cap * sizeof(uint64_t));
+            }
+            b->ns[b->count++] = fan[i].samples.ns[k];
+        }
+        b->total += fan[i].samples.total;
+        fan_msgs += (long)fan[i].samples.count;
+        free(fan[i].samples.ns);
+    }
+    fan_wall = bench_now() - fan_wall;
+    wall = bench_now() - wall;
+
+    printf("%-22s %10s %12s %10s %10s %10s\n", "operation", "count", "ops/s", "p50 us", "p99 us", "p999 us");
+    for (int op = 0; op < B_OPS; ++op) {
+        BenchSamples* b = &bench_samples[op];
+        if (!b->count) continue;
+        qsort(b->ns, b->count, sizeof(uint64_t), bench_cmp_u64);
+        printf("%-22s %10zu %12.0f %10.2f %10.2f %10.2f\n", bench_names[op], b->count,
+               b->total ? (double)b->count * 1e9 / (double)b->total : 0.0,
+               bench_pct(b, 0.50), bench_pct(b, 0.99), bench_pct(b, 0.999));
+        free(b->ns);
+    }
+    if (threads)
+        printf("Fan-in: %d threads sent %ld messages to one user in %.3f s (%.0f msgs/s)\n",
+               threads, fan_msgs, (double)fan_wall / 1e9, fan_wall ? fan_msgs * 1e9 / (double)fan_wall : 0.0);
+    printf("Total wall time %.3f s (%zu assignments, %d subjects left in memory)\n",
+           (double)wall / 1e9, (size_t)heap_size, subject_count);
+    print_mem_stats(stdout);
+    uint64_t t = bench_now();
+    classroom_teardown();
+    size_t left = 0;
+    for (int i = 0; i < MEM_POOLS; ++i) left += mem_pools[i].bytes + mem_pools[i].objects;
+    printf("Teardown took %.3f ms%s\n", (double)(bench_now() - t) / 1e6, left ? " and left memory behind" : "");
+    free(bench_zipf_cdf);
+    free(names);
+    free(ids);
+    return 0;
+}
+
 /* =========================
    Entry point
    ========================= */
 
-int main() {
-    // initialize chat adjacency to NULL for indices up to reasonable bound
-    for (int i=0;i<1000;i++) chat_adj[i] = NULL;
-    // sample data
-    init_sample_data();
+int main(int argc, char** argv) {
+    int batch = argc > 1 && strcmp(argv[1], "--batch") == 0;
+    int bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+    int serve = argc > 1 && strcmp(argv[1], "--serve") == 0;
+    if (argc > 1 && !(batch && argc <= 3) && !(bench && argc <= 5) && !(serve && argc <= 4)) {
+        fprintf(stderr, "usage: %s [--batch [file|-]] [--bench [users] [ops] [subjects]]"
+                        " [--serve [socket] [workers]]\n", argv[0]);
+        return 1;
+    }
+    int workers = serve && argc > 3 ? atoi(argv[3]) : SERVER_WORKERS;
+    if (workers < 1 || workers > SERVER_MAX_WORKERS) {
+        fprintf(stderr, "workers must be 1..%d\n", SERVER_MAX_WORKERS);
+        return 1;
+    }
+    if (bench) { // in-memory only: never touches the snapshot or the log
+        int users = argc > 2 ? atoi(argv[2]) : 10000;
+        long ops = argc > 3 ? atol(argv[3]) : 200000;
+        int subjects = argc > 4 ? atoi(argv[4]) : 50;
+        if (users < 2 || ops < 0 || subjects < 0) { fprintf(stderr, "bench: bad arguments\n"); return 1; }
+        return run_bench(users, ops, subjects);
+    }
+    FILE* notes = batch || serve ? stderr : stdout; // keep batch stdout machine-readable
+    const char* env; // chat retention overrides; 0 keeps everything
+    if ((env = getenv("CLASSROOM_RETAIN_MESSAGES")) != NULL) chat_retain_messages = atol(env);
+    if ((env = getenv("CLASSROOM_RETAIN_DAYS")) != NULL) chat_retain_days = atol(env);
+    // restore the last snapshot plus the log written after it, or start from sample data
+    int rc = load_snapshot(SNAPSHOT_FILE);
+    if (rc == -2) { // starting over it would overwrite the file and orphan the log behind it
+        fprintf(stderr, "Snapshot %s is unreadable; move it aside to start without it.\n", SNAPSHOT_FILE);
+        return 1;
+    }
+    long replayed = wal_recover();
+    if (replayed > 0) fprintf(notes, "Recovered %ld logged changes.\n", replayed);
+    if (rc != 0 && replayed == 0) init_sample_data();
+    else if (replayed > 0) checkpoint(1);
+    if (batch || serve) {
+        int status = batch ? run_batch(argc > 2 ? argv[2] : NULL)
+                           : run_server(argc > 2 ? argv[2] : SERVER_SOCKET, workers);
+        if (checkpoint(0) != 0) { fprintf(stderr, "Unable to write snapshot %s.\n", SNAPSHOT_FILE); status = 1; }
+        classroom_teardown();
+        return status;
+    }
     printf("Welcome to DSA-Based Cloud Classroom Simulation\n");
     main_menu();
+    if (checkpoint(0) != 0) printf("Unable to write snapshot %s.\n", SNAPSHOT_FILE);
+    classroom_teardown();
     return 0;
 }
@@ -2,14 +2,75 @@
 #include <stdlib.h>
 #include <string.h>
 
-void ll_init(LinkedList* ll) { ll->head = NULL; ll->length = 0; }
+void ll_init(LinkedList* ll) { ll->head = ll->tail = NULL; ll->length = 0; }
 void ll_append(LinkedList* ll, Topic v) {
 	ListNode* n = (ListNode*)malloc(sizeof(ListNode));
 	n->value = v; n->next = NULL;
-	if (!ll->head) ll->head = n; else { ListNode* c = ll->head; while (c->next) c = c->next; c->next = n; }
+	if (!ll->head) ll->head = n; else ll->tail->next = n;
+	ll->tail = n;
 	ll->length++;
 }
-void ll_free(LinkedList* ll) { ListNode* c = ll->head; while (c) { ListNode* t = c->next; free(c); c = t; } ll->head = NULL; ll->length = 0; }
+void ll_free(LinkedList* ll) { ListNode* c = ll->head; while (c) { ListNode* t = c->next; free(c); c = t; } ll->head = ll->tail = NULL; ll->length = 0; }
+
+#if defined(__GNUC__) || defined(__clang__)
+static size_t popcount64(uint64_t x) { return (size_t)__builtin_popcountll(x); }
+static int ctz64(uint64_t x) { return __builtin_ctzll(x); }
+#else
+static size_t popcount64(uint64_t x) { x -= (x >> 1) & 0x5555555555555555ULL; x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL); x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL; return (size_t)((x * 0x0101010101010101ULL) >> 56); }
+static int ctz64(uint64_t x) { int n = 0; while (!(x & 1)) { x >>= 1; n++; } return n; }
+#endif
+
+// Grows the pool to fit extra more bytes. Strings passed in strs may already
+// live in the pool, so they are moved along with it.
+static void ts_reserve(TopicStore* s, size_t extra, const char** strs, int k) {
+	if (s->poolLen + extra <= s->poolCap) return;
+	size_t at[3]; bool inPool[3];
+	for (int j = 0; j < k; ++j) { inPool[j] = strs[j] && strs[j] >= s->pool && strs[j] < s->pool + s->poolLen; at[j] = inPool[j] ? (size_t)(strs[j] - s->pool) : 0; }
+	while (s->poolLen + extra > s->poolCap) s->poolCap *= 2;
+	s->pool = (char*)realloc(s->pool, s->poolCap);
+	for (int j = 0; j < k; ++j) if (inPool[j]) strs[j] = s->pool + at[j];
+}
+// Offset 0 of the pool is the empty string, shared by every missing field.
+static uint32_t ts_intern(TopicStore* s, const char* str) {
+	if (!str || !*str) return 0;
+	size_t n = strlen(str) + 1;
+	ts_reserve(s, n, &str, 1);
+	uint32_t off = (uint32_t)s->poolLen; memcpy(s->pool + off, str, n); s->poolLen += n;
+	return off;
+}
+void ts_init(TopicStore* s) { memset(s, 0, sizeof(*s)); s->poolCap = 256; s->pool = (char*)malloc(s->poolCap); s->pool[0] = '\0'; s->poolLen = 1; }
+size_t ts_append(TopicStore* s, const char* title, const char* plannedDate, const char* resourceUrl) {
+	if (s->count == s->cap) {
+		size_t ncap = s->cap ? s->cap * 2 : 64, words = (s->cap + 63) / 64, nwords = (ncap + 63) / 64;
+		s->taught = (uint64_t*)realloc(s->taught, nwords * sizeof(uint64_t)); memset(s->taught + words, 0, (nwords - words) * sizeof(uint64_t));
+		s->studied = (uint64_t*)realloc(s->studied, nwords * sizeof(uint64_t)); memset(s->studied + words, 0, (nwords - words) * sizeof(uint64_t));
+		s->title = (uint32_t*)realloc(s->title, ncap * sizeof(uint32_t));
+		s->plannedDate = (uint32_t*)realloc(s->plannedDate, ncap * sizeof(uint32_t));
+		s->resourceUrl = (uint32_t*)realloc(s->resourceUrl, ncap * sizeof(uint32_t));
+		s->cap = ncap;
+	}
+	const char* strs[3] = { title, plannedDate, resourceUrl }; size_t need = 0;
+	for (int j = 0; j < 3; ++j) if (strs[j]) need += strlen(strs[j]) + 1;
+	ts_reserve(s, need, strs, 3); // one move for all three, before any of them is copied
+	size_t i = s->count++;
+	s->title[i] = ts_intern(s, strs[0]); s->plannedDate[i] = ts_intern(s, strs[1]); s->resourceUrl[i] = ts_intern(s, strs[2]);
+	return i;
+}
+const char* ts_title(const TopicStore* s, size_t i) { return s->pool + s->title[i]; }
+const char* ts_planned_date(const TopicStore* s, size_t i) { return s->pool + s->plannedDate[i]; }
+const char* ts_resource_url(const TopicStore* s, size_t i) { return s->pool + s->resourceUrl[i]; }
+// The old string stays in the pool; dates change rarely.
+void ts_set_planned_date(TopicStore* s, size_t i, const char* date) { if (i < s->count) s->plannedDate[i] = ts_intern(s, date); }
+static bool bit_get(const uint64_t* b, size_t i) { return (b[i / 64] >> (i % 64)) & 1; }
+static void bit_set(uint64_t* b, size_t i, bool v) { if (v) b[i / 64] |= 1ULL << (i % 64); else b[i / 64] &= ~(1ULL << (i % 64)); }
+bool ts_taught(const TopicStore* s, size_t i) { return i < s->count && bit_get(s->taught, i); }
+bool ts_studied(const TopicStore* s, size_t i) { return i < s->count && bit_get(s->studied, i); }
+void ts_set_taught(TopicStore* s, size_t i, bool v) { if (i < s->count) bit_set(s->taught, i, v); }
+void ts_set_studied(TopicStore* s, size_t i, bool v) { if (i < s->count) bit_set(s->studied, i, v); }
+static size_t bits_count(const uint64_t* b, size_t n) { size_t c = 0; for (size_t w = 0; w < (n + 63) / 64; ++w) c += popcount64(b[w]); return c; }
+size_t ts_count_taught(const TopicStore* s) { return bits_count(s->taught, s->count); }
+size_t ts_count_studied(const TopicStore* s) { return bits_count(s->studied, s->count); }
+void ts_free(TopicStore* s) { free(s->taught); free(s->studied); free(s->title); free(s->plannedDate); free(s->resourceUrl); free(s->pool); memset(s, 0, sizeof(*s)); }
 
 void stack_init(Stack* s) { s->items = NULL; s->size = 0; s->cap = 0; }
 void stack_push(Stack* s, const char* str) {
@@ -19,6 +80,107 @@ void stack_push(Stack* s, const char* str) {
 char* stack_pop(Stack* s) { if (!s->size) return NULL; char* out = s->items[s->size - 1]; s->size--; return out; }
 void stack_free(Stack* s) { for (size_t i = 0; i < s->size; ++i) free(s->items[i]); free(s->items); s->items = NULL; s->size = s->cap = 0; }
 
+void arena_init(Arena* a) { a->top = NULL; }
+void* arena_alloc(Arena* a, size_t n) {
+	ArenaChunk* c = a->top;
+	size_t off = c ? (c->used + 7) & ~(size_t)7 : 0;
+	if (!c || off + n > c->cap) {
+		size_t cap = n > ARENA_CHUNK ? n : ARENA_CHUNK;
+		c = (ArenaChunk*)malloc(sizeof(ArenaChunk) + cap); c->prev = a->top; c->used = 0; c->cap = cap;
+		a->top = c; off = 0;
+	}
+	c->used = off + n;
+	return c->data + off;
+}
+ArenaMark arena_mark(const Arena* a) { ArenaMark m = { a->top, a->top ? a->top->used : 0 }; return m; }
+void arena_rewind(Arena* a, ArenaMark m) {
+	while (a->top != m.chunk) { ArenaChunk* c = a->top; a->top = c->prev; free(c); }
+	if (a->top) a->top->used = m.used;
+}
+void arena_free(Arena* a) { ArenaMark none = { NULL, 0 }; arena_rewind(a, none); }
+
+static char* arena_copy(Arena* a, const char* s, size_t n) { char* out = (char*)arena_alloc(a, n + 1); memcpy(out, s, n); out[n] = '\0'; return out; }
+// The live text is a gap buffer: text[0, gapStart) then text[gapEnd, textCap).
+static size_t notes_length(const NotesHistory* h) { return h->textCap - (h->gapEnd - h->gapStart); }
+static void notes_gap_move(NotesHistory* h, size_t pos) {
+	if (pos < h->gapStart) { size_t n = h->gapStart - pos; memmove(h->text + h->gapEnd - n, h->text + pos, n); h->gapStart -= n; h->gapEnd -= n; }
+	else if (pos > h->gapStart) { size_t n = pos - h->gapStart; memmove(h->text + h->gapStart, h->text + h->gapEnd, n); h->gapStart += n; h->gapEnd += n; }
+}
+static void notes_gap_reserve(NotesHistory* h, size_t n) {
+	if (h->gapEnd - h->gapStart >= n) return;
+	size_t len = notes_length(h), tail = h->textCap - h->gapEnd, cap = h->textCap;
+	while (cap - len < n) cap *= 2;
+	h->text = (char*)realloc(h->text, cap);
+	memmove(h->text + cap - tail, h->text + h->gapEnd, tail);
+	h->gapEnd = cap - tail; h->textCap = cap;
+}
+// Make the `from` bytes at pos into the `to` bytes of mid; the gap ends up
+// right after them, where undoing this edit will need it.
+static void notes_replace(NotesHistory* h, size_t pos, size_t from, const char* mid, size_t to) {
+	notes_gap_move(h, pos + from); h->gapStart = pos;
+	notes_gap_reserve(h, to + 1); // one spare byte for the terminator notes_current writes
+	memcpy(h->text + pos, mid, to); h->gapStart += to;
+}
+static void notes_copy_out(const NotesHistory* h, char* out) {
+	memcpy(out, h->text, h->gapStart); memcpy(out + h->gapStart, h->text + h->gapEnd, h->textCap - h->gapEnd);
+	out[notes_length(h)] = '\0';
+}
+// Make text[pre, pre + from) into the `to` bytes of mid, keeping what follows.
+static void notes_splice(char* text, size_t len, size_t pre, size_t from, const char* mid, size_t to) {
+	memmove(text + pre + to, text + pre + from, len - pre - from + 1);
+	memcpy(text + pre, mid, to);
+}
+static void notes_push(NotesHistory* h, NoteVersion v) {
+	if (h->count == h->cap) { h->cap = h->cap ? h->cap * 2 : 16; h->versions = (NoteVersion*)realloc(h->versions, h->cap * sizeof(NoteVersion)); }
+	if (h->count % NOTES_KEYFRAME == 0) { char* k = (char*)arena_alloc(&h->arena, v.length + 1); notes_copy_out(h, k); v.keyframe = k; }
+	h->versions[h->count++] = v;
+}
+void notes_init(NotesHistory* h, const char* text) {
+	memset(h, 0, sizeof(*h)); arena_init(&h->arena);
+	size_t len = text ? strlen(text) : 0;
+	h->textCap = 64; while (len + 1 > h->textCap) h->textCap *= 2;
+	h->text = (char*)malloc(h->textCap);
+	if (len) memcpy(h->text, text, len);
+	h->gapStart = len; h->gapEnd = h->textCap;
+	NoteVersion v = { arena_mark(&h->arena), len, 0, 0, 0, NULL, NULL };
+	notes_push(h, v);
+}
+// Saving reads the whole new text anyway, so it closes the gap to compare.
+bool notes_save(NotesHistory* h, const char* text) {
+	size_t len = notes_length(h), nlen = strlen(text), pre = 0, suf = 0;
+	notes_gap_move(h, len);
+	while (pre < len && pre < nlen && h->text[pre] == text[pre]) pre++;
+	if (pre == len && pre == nlen) return false;
+	while (suf < len - pre && suf < nlen - pre && h->text[len - 1 - suf] == text[nlen - 1 - suf]) suf++;
+	NoteVersion v = { arena_mark(&h->arena), nlen, pre, nlen - pre - suf, len - pre - suf, NULL, NULL };
+	v.old = arena_copy(&h->arena, h->text + pre, v.oldMid);
+	notes_replace(h, pre, v.oldMid, text + pre, v.newMid);
+	notes_push(h, v);
+	return true;
+}
+const char* notes_current(NotesHistory* h) { size_t len = notes_length(h); notes_gap_move(h, len); h->text[len] = '\0'; return h->text; }
+bool notes_undo(NotesHistory* h) {
+	if (h->count < 2) return false;
+	NoteVersion* v = &h->versions[--h->count];
+	notes_replace(h, v->prefix, v->newMid, v->old, v->oldMid);
+	arena_rewind(&h->arena, v->mark);
+	return true;
+}
+// Start from the next keyframe at or after k (or the current text) and
+// undo the versions in between on a copy.
+char* notes_version(const NotesHistory* h, size_t k) {
+	if (k >= h->count) return NULL;
+	size_t j = (k + NOTES_KEYFRAME - 1) / NOTES_KEYFRAME * NOTES_KEYFRAME, cap = 0;
+	const char* start = j < h->count ? h->versions[j].keyframe : NULL; // NULL: the live text
+	if (j >= h->count) j = h->count - 1;
+	for (size_t i = k; i <= j; ++i) if (h->versions[i].length > cap) cap = h->versions[i].length;
+	char* out = (char*)malloc(cap + 1);
+	if (start) memcpy(out, start, h->versions[j].length + 1); else notes_copy_out(h, out);
+	for (size_t i = j; i > k; --i) { const NoteVersion* v = &h->versions[i]; notes_splice(out, v->length, v->prefix, v->newMid, v->old, v->oldMid); }
+	return out;
+}
+void notes_free(NotesHistory* h) { arena_free(&h->arena); free(h->versions); free(h->text); memset(h, 0, sizeof(*h)); }
+
 void queue_init(Queue* q) { q->items = NULL; q->head = q->tail = q->size = q->cap = 0; }
 void queue_enqueue(Queue* q, int v) {
 	if (q->size + 1 > q->cap) { size_t ncap = q->cap ? q->cap * 2 : 4; int* nitems = (int*)malloc(ncap * sizeof(int)); for (size_t i = 0; i < q->size; ++i) nitems[i] = q->items[(q->head + i) % (q->cap ? q->cap : 1)]; free(q->items); q->items = nitems; q->cap = ncap; q->head = 0; q->tail = q->size; }
@@ -27,6 +189,92 @@ void queue_enqueue(Queue* q, int v) {
 int queue_dequeue(Queue* q, int* ok) { if (!q->size) { if (ok) *ok = 0; return 0; } int v = q->items[q->head]; q->head = (q->head + 1) % q->cap; q->size--; if (ok) *ok = 1; return v; }
 void queue_free(Queue* q) { free(q->items); q->items = NULL; q->head = q->tail = q->size = q->cap = 0; }
 
+#define TW_BITS 6 // log2(TW_SLOTS)
+static void tw_link(TimerWheel* w, int n, int level, int slot) {
+	TimerNode* t = &w->nodes[n];
+	t->level = level; t->slot = slot; t->prev = -1; t->next = w->head[level][slot];
+	if (t->next >= 0) w->nodes[t->next].prev = n;
+	w->head[level][slot] = n; w->occupied[level] |= 1ULL << slot;
+}
+static void tw_unlink(TimerWheel* w, int n) {
+	TimerNode* t = &w->nodes[n];
+	if (t->prev >= 0) w->nodes[t->prev].next = t->next; else w->head[t->level][t->slot] = t->next;
+	if (t->next >= 0) w->nodes[t->next].prev = t->prev;
+	if (w->head[t->level][t->slot] < 0) w->occupied[t->level] &= ~(1ULL << t->slot);
+}
+// Lowest level whose range covers the delay; never the slot a level is in
+// now, so each slot is reached by exactly one boundary. Beyond the top
+// level the entry waits in its last slot and is placed again from there.
+static void tw_place(TimerWheel* w, int n) {
+	uint64_t when = w->nodes[n].when < w->now ? w->now : w->nodes[n].when;
+	for (int level = 0; level < TW_LEVELS; ++level) {
+		int shift = TW_BITS * level;
+		if ((when >> shift) - (w->now >> shift) < TW_SLOTS) { tw_link(w, n, level, (int)((when >> shift) & (TW_SLOTS - 1))); return; }
+	}
+	int top = TW_BITS * (TW_LEVELS - 1);
+	tw_link(w, n, TW_LEVELS - 1, (int)(((w->now >> top) + TW_SLOTS - 1) & (TW_SLOTS - 1)));
+}
+// Earliest tick at which some occupied slot is due: a level-0 slot at its
+// own tick, a higher one at the boundary where it moves down.
+static bool tw_next_tick(const TimerWheel* w, uint64_t* out) {
+	bool found = false;
+	for (int level = 0; level < TW_LEVELS; ++level) {
+		uint64_t m = w->occupied[level];
+		if (!m) continue;
+		int shift = TW_BITS * level, pos = (int)((w->now >> shift) & (TW_SLOTS - 1));
+		uint64_t rot = pos ? (m >> pos) | (m << (TW_SLOTS - pos)) : m;
+		uint64_t t = ((w->now >> shift) + (uint64_t)ctz64(rot)) << shift;
+		if (t < w->now) t = w->now;
+		if (!found || t < *out) *out = t;
+		found = true;
+	}
+	return found;
+}
+void tw_init(TimerWheel* w, uint64_t now) { memset(w, 0, sizeof(*w)); memset(w->head, 0xff, sizeof(w->head)); w->now = now; w->freeList = -1; }
+TimerHandle tw_add(TimerWheel* w, uint64_t when, int topic) {
+	if (w->freeList < 0) {
+		int ncap = w->cap ? w->cap * 2 : 64;
+		w->nodes = (TimerNode*)realloc(w->nodes, (size_t)ncap * sizeof(TimerNode));
+		for (int i = ncap - 1; i >= w->cap; --i) { w->nodes[i].level = -1; w->nodes[i].gen = 0; w->nodes[i].next = w->freeList; w->freeList = i; }
+		w->cap = ncap;
+	}
+	int n = w->freeList; w->freeList = w->nodes[n].next;
+	w->nodes[n].when = when; w->nodes[n].topic = topic;
+	tw_place(w, n); w->pending++;
+	return (TimerHandle)w->nodes[n].gen << 32 | (uint32_t)n;
+}
+// Bumping the generation on release makes every handle to the old entry stale.
+static void tw_release(TimerWheel* w, int n) { w->nodes[n].level = -1; w->nodes[n].gen++; w->nodes[n].next = w->freeList; w->freeList = n; w->pending--; }
+// Node index of a pending entry, -1 if h is stale or was never handed out.
+static int tw_resolve(const TimerWheel* w, TimerHandle h) {
+	uint32_t n = (uint32_t)h;
+	if (n >= (uint32_t)w->cap || w->nodes[n].level < 0 || w->nodes[n].gen != (uint32_t)(h >> 32)) return -1;
+	return (int)n;
+}
+int tw_cancel(TimerWheel* w, TimerHandle h) { int n = tw_resolve(w, h); if (n < 0) return -1; tw_unlink(w, n); tw_release(w, n); return 0; }
+int tw_reschedule(TimerWheel* w, TimerHandle h, uint64_t when) { int n = tw_resolve(w, h); if (n < 0) return -1; tw_unlink(w, n); w->nodes[n].when = when; tw_place(w, n); return 0; }
+size_t tw_advance(TimerWheel* w, uint64_t upto, int* out, size_t max) {
+	size_t fired = 0;
+	uint64_t t = 0;
+	while (fired < max) {
+		if (!tw_next_tick(w, &t) || t > upto) { if (upto >= w->now) w->now = upto + 1; break; }
+		w->now = t;
+		for (int level = TW_LEVELS - 1; level > 0; --level) { // move down every slot whose boundary this is
+			int shift = TW_BITS * level, slot = (int)((t >> shift) & (TW_SLOTS - 1));
+			if ((t & ((1ULL << shift) - 1)) || !((w->occupied[level] >> slot) & 1)) continue;
+			int n = w->head[level][slot];
+			w->head[level][slot] = -1; w->occupied[level] &= ~(1ULL << slot);
+			while (n >= 0) { int next = w->nodes[n].next; tw_place(w, n); n = next; }
+		}
+		int slot = (int)(t & (TW_SLOTS - 1));
+		while (fired < max && w->head[0][slot] >= 0) { int n = w->head[0][slot]; tw_unlink(w, n); out[fired++] = w->nodes[n].topic; tw_release(w, n); }
+		if (w->head[0][slot] >= 0) break; // out is full; the rest of this tick fires next time
+		w->now = t + 1;
+	}
+	return fired;
+}
+void tw_free(TimerWheel* w) { free(w->nodes); tw_init(w, w->now); }
+
 TreeNode* tree_create(const char* label) { TreeNode* n = (TreeNode*)malloc(sizeof(TreeNode)); strncpy(n->label, label, sizeof(n->label)); n->label[sizeof(n->label)-1] = '\0'; n->children = NULL; n->childCount = 0; n->childCap = 0; return n; }
 void tree_add_child(TreeNode* parent, TreeNode* child) { if (parent->childCount == parent->childCap) { parent->childCap = parent->childCap ? parent->childCap * 2 : 2; parent->children = (TreeNode**)realloc(parent->children, parent->childCap * sizeof(TreeNode*)); } parent->children[parent->childCount++] = child; }
 void tree_free(TreeNode* root) { if (!root) return; for (size_t i = 0; i < root->childCount; ++i) tree_free(root->children[i]); free(root->children); free(root); }
@@ -35,3 +283,209 @@ void graph_init(Graph* g, int n) { g->n = n > MAXV ? MAXV : n; for (int i = 0; i
 void graph_add_edge(Graph* g, int u, int v) { if (u >= 0 && v >= 0 && u < g->n && v < g->n) g->adj[u][v] = 1; }
 int graph_indegree(Graph* g, int v) { int d = 0; if (v < 0 || v >= g->n) return 0; for (int u = 0; u < g->n; ++u) if (g->adj[u][v]) d++; return d; }
 
+
+void dg_init(DepGraph* g) { memset(g, 0, sizeof(*g)); g->dirty = true; }
+void dg_resize(DepGraph* g, int n) {
+	if (n <= g->n) return;
+	if (n > g->cap) {
+		int ncap = g->cap ? g->cap : 64; while (ncap < n) ncap *= 2;
+		g->indeg = (int*)realloc(g->indeg, (size_t)ncap * sizeof(int)); g->outdeg = (int*)realloc(g->outdeg, (size_t)ncap * sizeof(int));
+		g->cap = ncap;
+	}
+	memset(g->indeg + g->n, 0, (size_t)(n - g->n) * sizeof(int)); memset(g->outdeg + g->n, 0, (size_t)(n - g->n) * sizeof(int));
+	g->n = n; g->dirty = true; g->version++;
+}
+int dg_add_vertex(DepGraph* g) { dg_resize(g, g->n + 1); return g->n - 1; }
+static size_t edge_slot(uint64_t key, size_t cap) { key ^= key >> 33; key *= 0xff51afd7ed558ccdULL; key ^= key >> 33; return (size_t)key & (cap - 1); }
+static bool eset_insert(DepGraph* g, uint64_t key) {
+	if ((g->m + 1) * 2 > g->esetCap) {
+		size_t ncap = g->esetCap ? g->esetCap * 2 : 256; uint64_t* ns = (uint64_t*)calloc(ncap, sizeof(uint64_t));
+		for (size_t i = 0; i < g->esetCap; ++i) if (g->eset[i]) { size_t j = edge_slot(g->eset[i], ncap); while (ns[j]) j = (j + 1) & (ncap - 1); ns[j] = g->eset[i]; }
+		free(g->eset); g->eset = ns; g->esetCap = ncap;
+	}
+	size_t i = edge_slot(key, g->esetCap);
+	for (; g->eset[i]; i = (i + 1) & (g->esetCap - 1)) if (g->eset[i] == key) return false;
+	g->eset[i] = key;
+	return true;
+}
+int dg_add_edge(DepGraph* g, int u, int v) {
+	if (u < 0 || v < 0 || u >= g->n || v >= g->n) return -1;
+	if (!eset_insert(g, ((uint64_t)(uint32_t)u << 32 | (uint32_t)v) + 1)) return 0;
+	if (g->m == g->mcap) { g->mcap = g->mcap ? g->mcap * 2 : 64; g->eu = (int*)realloc(g->eu, g->mcap * sizeof(int)); g->ev = (int*)realloc(g->ev, g->mcap * sizeof(int)); }
+	g->eu[g->m] = u; g->ev[g->m] = v; g->m++;
+	g->outdeg[u]++; g->indeg[v]++;
+	g->dirty = true; g->version++;
+	return 1;
+}
+int dg_indegree(const DepGraph* g, int v) { return v >= 0 && v < g->n ? g->indeg[v] : 0; }
+// Counting sort of the edge list by one endpoint; deg gives the bucket sizes.
+static void csr_fill(int n, size_t m, const int* deg, const int* key, const int* val, int** off, int** out) {
+	*off = (int*)realloc(*off, (size_t)(n + 1) * sizeof(int)); *out = (int*)realloc(*out, (m ? m : 1) * sizeof(int));
+	int k = 0; for (int i = 0; i < n; ++i) { (*off)[i] = k; k += deg[i]; } (*off)[n] = k;
+	int* pos = (int*)malloc((size_t)(n ? n : 1) * sizeof(int)); memcpy(pos, *off, (size_t)n * sizeof(int));
+	for (size_t e = 0; e < m; ++e) (*out)[pos[key[e]]++] = val[e];
+	free(pos);
+}
+static void dg_build(DepGraph* g) {
+	if (!g->dirty) return;
+	csr_fill(g->n, g->m, g->outdeg, g->eu, g->ev, &g->fwdOff, &g->fwd);
+	csr_fill(g->n, g->m, g->indeg, g->ev, g->eu, &g->revOff, &g->rev);
+	g->dirty = false;
+}
+const int* dg_successors(DepGraph* g, int u, int* count) { if (u < 0 || u >= g->n) { *count = 0; return NULL; } dg_build(g); *count = g->fwdOff[u + 1] - g->fwdOff[u]; return g->fwd + g->fwdOff[u]; }
+const int* dg_predecessors(DepGraph* g, int v, int* count) { if (v < 0 || v >= g->n) { *count = 0; return NULL; } dg_build(g); *count = g->revOff[v + 1] - g->revOff[v]; return g->rev + g->revOff[v]; }
+int dg_topo_order(DepGraph* g, int* out) {
+	StudyScheduler s; sched_init(&s, g);
+	int k = 0, v;
+	while ((v = sched_next(&s)) >= 0) { out[k++] = v; sched_done(&s, v); }
+	sched_free(&s);
+	return k;
+}
+// Whatever Kahn leaves behind has a predecessor that was also left behind,
+// so walking predecessors from there must come back to itself.
+int dg_find_cycle(DepGraph* g, int* out) {
+	StudyScheduler s; sched_init(&s, g);
+	int v, len = 0, start = -1;
+	while ((v = sched_next(&s)) >= 0) sched_done(&s, v);
+	for (int i = 0; i < g->n && start < 0; ++i) if (s.pending[i] > 0) start = i;
+	if (start >= 0) {
+		int* seen = s.ready; // reused: step at which each vertex was visited, -1 = not yet
+		for (int i = 0; i < g->n; ++i) seen[i] = -1;
+		int* walk = (int*)malloc((size_t)g->n * sizeof(int)); int steps = 0;
+		for (v = start; seen[v] < 0; ) {
+			seen[v] = steps; walk[steps++] = v;
+			int cnt; const int* p = dg_predecessors(g, v, &cnt);
+			for (int i = 0; i < cnt; ++i) if (s.pending[p[i]] > 0) { v = p[i]; break; }
+		}
+		for (int i = steps - 1; i >= seen[v]; --i) out[len++] = walk[i]; // predecessors reversed = edge order
+		free(walk);
+	}
+	sched_free(&s);
+	return len;
+}
+void dg_free(DepGraph* g) { free(g->indeg); free(g->outdeg); free(g->eu); free(g->ev); free(g->eset); free(g->fwdOff); free(g->fwd); free(g->revOff); free(g->rev); dg_init(g); }
+
+// Successors are copied so that edges or topics added to g later cannot
+// index past pending or unlock a topic early.
+void sched_init(StudyScheduler* s, DepGraph* g) {
+	size_t n = (size_t)(g->n ? g->n : 1);
+	dg_build(g);
+	s->n = g->n;
+	s->pending = (int*)malloc(n * sizeof(int)); s->ready = (int*)malloc(n * sizeof(int)); s->head = s->tail = 0;
+	s->succOff = (int*)malloc((n + 1) * sizeof(int)); s->succ = (int*)malloc((g->m ? g->m : 1) * sizeof(int));
+	if (g->n) { memcpy(s->pending, g->indeg, (size_t)g->n * sizeof(int)); memcpy(s->succOff, g->fwdOff, (n + 1) * sizeof(int)); }
+	else s->succOff[0] = 0;
+	if (g->m) memcpy(s->succ, g->fwd, g->m * sizeof(int));
+	s->state = (unsigned char*)calloc(n, 1);
+	for (int v = 0; v < g->n; ++v) if (!s->pending[v]) { s->ready[s->tail++] = v; s->state[v] = SCHED_READY; }
+}
+int sched_next(StudyScheduler* s) {
+	if (s->head == s->tail) return -1;
+	int v = s->ready[s->head++]; s->state[v] = SCHED_STUDYING;
+	return v;
+}
+// Only a topic handed out and not finished yet may release its successors,
+// so pending never counts a prerequisite twice.
+int sched_done(StudyScheduler* s, int v) {
+	if (v < 0 || v >= s->n || s->state[v] != SCHED_STUDYING) return -1;
+	s->state[v] = SCHED_DONE;
+	for (int i = s->succOff[v]; i < s->succOff[v + 1]; ++i)
+		if (--s->pending[s->succ[i]] == 0) { s->ready[s->tail++] = s->succ[i]; s->state[s->succ[i]] = SCHED_READY; }
+	return 0;
+}
+void sched_free(StudyScheduler* s) { free(s->pending); free(s->ready); free(s->succOff); free(s->succ); free(s->state); memset(s, 0, sizeof(*s)); }
+
+// 256 bits per step where the compiler has vector types (SSE2/AVX2/NEON
+// underneath), one word at a time elsewhere.
+static void row_or(uint64_t* restrict dst, const uint64_t* restrict src, size_t words) {
+	size_t i = 0;
+#if defined(__GNUC__) || defined(__clang__)
+	typedef uint64_t u64x4 __attribute__((vector_size(32)));
+	for (; i + 4 <= words; i += 4) { u64x4 a, b; memcpy(&a, dst + i, sizeof(a)); memcpy(&b, src + i, sizeof(b)); a |= b; memcpy(dst + i, &a, sizeof(a)); }
+#endif
+	for (; i < words; ++i) dst[i] |= src[i];
+}
+static uint64_t* reach_row(uint64_t* rows, const ReachIndex* r, int v) { return rows + (size_t)v * r->words; }
+static size_t row_list(const uint64_t* row, const uint64_t* skip, size_t words, int* out, size_t max) {
+	size_t count = 0;
+	for (size_t w = 0; w < words; ++w)
+		for (uint64_t b = row[w] & (skip ? ~skip[w] : ~0ULL); b; b &= b - 1, ++count)
+			if (count < max) out[count] = (int)(w * 64) + ctz64(b);
+	return count;
+}
+void reach_init(ReachIndex* r) { memset(r, 0, sizeof(*r)); }
+int reach_build(ReachIndex* r, DepGraph* g) {
+	int n = g->n;
+	int* order = (int*)malloc((size_t)(n ? n : 1) * sizeof(int));
+	reach_free(r);
+	r->graph = g; r->version = g->version; // a cyclic graph leaves an empty index for this version
+	if (dg_topo_order(g, order) < n) { free(order); return -1; }
+	r->n = n; r->words = ((size_t)n + 63) / 64;
+	r->before = (uint64_t*)calloc((size_t)n * r->words + 1, sizeof(uint64_t));
+	r->after = (uint64_t*)calloc((size_t)n * r->words + 1, sizeof(uint64_t));
+	for (int i = 0; i < n; ++i) {
+		int v = order[i], cnt; const int* p = dg_predecessors(g, v, &cnt);
+		uint64_t* row = reach_row(r->before, r, v);
+		for (int k = 0; k < cnt; ++k) { row_or(row, reach_row(r->before, r, p[k]), r->words); row[p[k] / 64] |= 1ULL << (p[k] % 64); }
+	}
+	for (int i = n - 1; i >= 0; --i) {
+		int u = order[i], cnt; const int* s = dg_successors(g, u, &cnt);
+		uint64_t* row = reach_row(r->after, r, u);
+		for (int k = 0; k < cnt; ++k) { row_or(row, reach_row(r->after, r, s[k]), r->words); row[s[k] / 64] |= 1ULL << (s[k] % 64); }
+	}
+	free(order);
+	return 0;
+}
+static bool reach_bit(const ReachIndex* r, int v, int u) {
+	if (u < 0 || v < 0 || u >= r->n || v >= r->n) return false;
+	return (r->before[(size_t)v * r->words + (size_t)u / 64] >> (u % 64)) & 1;
+}
+// Rebuild if the graph changed behind the index's back.
+static void reach_sync(ReachIndex* r) { if (r->graph && r->graph->version != r->version) reach_build(r, r->graph); }
+// New pairs are exactly (before(u) + u) x (v + after(v)). Neither u's nor
+// v's own row changes while the others are updated, since the graph stays
+// acyclic.
+int reach_add_edge(ReachIndex* r, DepGraph* g, int u, int v) {
+	if (u < 0 || v < 0 || u >= g->n || v >= g->n || u == v) return -1;
+	if (r->graph != g || r->version != g->version) { // built from another graph, or it changed since
+		if (reach_build(r, g) != 0) return -1;
+	}
+	if (reach_bit(r, u, v)) return -1; // v already comes before u
+	int added = dg_add_edge(g, u, v);
+	if (added <= 0) return added;
+	r->version = g->version;
+	if (reach_bit(r, v, u)) return added;
+	uint64_t* bu = reach_row(r->before, r, u);
+	uint64_t* av = reach_row(r->after, r, v);
+	for (size_t w = 0; w < r->words; ++w)
+		for (uint64_t b = av[w] | (w == (size_t)v / 64 ? 1ULL << (v % 64) : 0); b; b &= b - 1) {
+			uint64_t* row = reach_row(r->before, r, (int)(w * 64) + ctz64(b));
+			row_or(row, bu, r->words); row[u / 64] |= 1ULL << (u % 64);
+		}
+	for (size_t w = 0; w < r->words; ++w)
+		for (uint64_t b = bu[w] | (w == (size_t)u / 64 ? 1ULL << (u % 64) : 0); b; b &= b - 1) {
+			uint64_t* row = reach_row(r->after, r, (int)(w * 64) + ctz64(b));
+			row_or(row, av, r->words); row[v / 64] |= 1ULL << (v % 64);
+		}
+	return 1;
+}
+bool reach_requires(ReachIndex* r, int v, int u) { reach_sync(r); return reach_bit(r, v, u); }
+bool reach_ready(ReachIndex* r, int v, const uint64_t* studied) {
+	reach_sync(r);
+	if (v < 0 || v >= r->n) return false;
+	const uint64_t* row = r->before + (size_t)v * r->words;
+	uint64_t missing = 0;
+	for (size_t w = 0; w < r->words; ++w) missing |= row[w] & ~studied[w];
+	return !missing;
+}
+size_t reach_blocking(ReachIndex* r, int v, const uint64_t* studied, int* out, size_t max) {
+	reach_sync(r);
+	if (v < 0 || v >= r->n) return 0;
+	return row_list(r->before + (size_t)v * r->words, studied, r->words, out, max);
+}
+size_t reach_unlocks(ReachIndex* r, int u, int* out, size_t max) {
+	reach_sync(r);
+	if (u < 0 || u >= r->n) return 0;
+	return row_list(r->after + (size_t)u * r->words, NULL, r->words, out, max);
+}
+void reach_free(ReachIndex* r) { free(r->before); free(r->after); reach_init(r); }
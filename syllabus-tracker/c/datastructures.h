@@ -2,6 +2,7 @@
 #define DATASTRUCTURES_H
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef struct Topic {
 	char title[128];
@@ -19,6 +20,7 @@ typedef struct ListNode {
 
 typedef struct LinkedList {
 	ListNode* head;
+	ListNode* tail;
 	size_t length;
 } LinkedList;
 
@@ -26,6 +28,35 @@ void ll_init(LinkedList*);
 void ll_append(LinkedList*, Topic v);
 void ll_free(LinkedList*);
 
+// Topic store: one topic per index, struct-of-arrays. Flags are bitsets
+// (bit i = topic i) so progress counts are a popcount per 64 topics; the
+// strings live in one pool and are referenced by offset. Indices never
+// change; string pointers are valid until the next append or set.
+typedef struct TopicStore {
+	size_t count, cap;
+	uint64_t* taught;
+	uint64_t* studied;
+	uint32_t* title; // offsets into pool
+	uint32_t* plannedDate;
+	uint32_t* resourceUrl;
+	char* pool;
+	size_t poolLen, poolCap;
+} TopicStore;
+
+void ts_init(TopicStore*);
+size_t ts_append(TopicStore*, const char* title, const char* plannedDate, const char* resourceUrl);
+const char* ts_title(const TopicStore*, size_t i);
+const char* ts_planned_date(const TopicStore*, size_t i);
+const char* ts_resource_url(const TopicStore*, size_t i);
+void ts_set_planned_date(TopicStore*, size_t i, const char* date);
+bool ts_taught(const TopicStore*, size_t i);
+bool ts_studied(const TopicStore*, size_t i);
+void ts_set_taught(TopicStore*, size_t i, bool v);
+void ts_set_studied(TopicStore*, size_t i, bool v);
+size_t ts_count_taught(const TopicStore*);
+size_t ts_count_studied(const TopicStore*);
+void ts_free(TopicStore*);
+
 // Stack of strings (notes history)
 typedef struct Stack {
 	char** items;
@@ -38,6 +69,66 @@ void stack_push(Stack*, const char* s);
 char* stack_pop(Stack*);
 void stack_free(Stack*);
 
+// Bump arena: allocations are carved from chunks of at least ARENA_CHUNK
+// bytes. A mark taken before a run of allocations releases the whole run
+// at once, newest first.
+#define ARENA_CHUNK 4096
+
+typedef struct ArenaChunk {
+	struct ArenaChunk* prev;
+	size_t used, cap;
+	char data[];
+} ArenaChunk;
+
+typedef struct Arena {
+	ArenaChunk* top;
+} Arena;
+
+typedef struct ArenaMark {
+	ArenaChunk* chunk;
+	size_t used;
+} ArenaMark;
+
+void arena_init(Arena*);
+void* arena_alloc(Arena*, size_t n);
+ArenaMark arena_mark(const Arena*);
+void arena_rewind(Arena*, ArenaMark);
+void arena_free(Arena*);
+
+// Notes history: every saved version of a note. The latest text is kept
+// whole; each older version is the bytes the next save replaced (after the
+// common prefix and suffix), plus a full copy every NOTES_KEYFRAME
+// versions for reading an old version directly. Memory grows with the size
+// of the edits. The current text is a gap buffer left at the last edit, so
+// undo is O(edit): it touches only the edited bytes, plus the distance to
+// the previous edit when undoing several in a row, and gives its memory back
+// to the arena. notes_current closes the gap, O(text after it).
+#define NOTES_KEYFRAME 32
+
+typedef struct NoteVersion {
+	ArenaMark mark;       // arena before this version's data
+	size_t length;        // of this version
+	size_t prefix;        // bytes shared with the previous version at the start
+	size_t newMid, oldMid; // this version has newMid bytes where the previous had oldMid
+	const char* old;      // those oldMid bytes
+	const char* keyframe; // full text of this version, or NULL
+} NoteVersion;
+
+typedef struct NotesHistory {
+	Arena arena;
+	NoteVersion* versions; // [0] is the initial text, [count-1] the current one
+	size_t count, cap;
+	char* text; // current version: text[0, gapStart) + text[gapEnd, textCap)
+	size_t textCap, gapStart, gapEnd;
+} NotesHistory;
+
+void notes_init(NotesHistory*, const char* text);
+bool notes_save(NotesHistory*, const char* text); // false if nothing changed
+const char* notes_current(NotesHistory*); // valid until the next save or undo
+bool notes_undo(NotesHistory*); // back to the previous version; false if there is none
+char* notes_version(const NotesHistory*, size_t k); // malloc'd copy of version k, NULL if out of range
+void notes_free(NotesHistory*);
+
 // Queue of reminder ints (epoch days)
 typedef struct Queue {
 	int* items;
@@ -52,6 +143,43 @@ void queue_enqueue(Queue*, int v);
 int queue_dequeue(Queue*, int* ok);
 void queue_free(Queue*);
 
+// Reminder wheel: hierarchical timing wheel, TW_LEVELS levels of TW_SLOTS
+// slots, each level 64 times coarser than the one below. Ticks are whatever
+// unit the caller picks (minutes in the demo). Adding, cancelling and
+// rescheduling are O(1); an entry is moved down a level at most
+// TW_LEVELS - 1 times before it fires, and tw_advance jumps straight to
+// the next occupied slot, so polling costs what is due, not what is pending.
+#define TW_LEVELS 4
+#define TW_SLOTS 64
+
+typedef struct TimerNode {
+	uint64_t when;
+	int topic;
+	int prev, next; // slot list, or free list through next
+	int level, slot; // level -1 = free
+	uint32_t gen; // bumped each time the node is freed
+} TimerNode;
+
+typedef struct TimerWheel {
+	uint64_t now; // next tick to process
+	uint64_t occupied[TW_LEVELS]; // bit s = slot s has entries
+	int head[TW_LEVELS][TW_SLOTS];
+	TimerNode* nodes;
+	int cap, freeList;
+	size_t pending;
+} TimerWheel;
+
+// gen << 32 | node; a handle goes stale once its entry fires or is cancelled,
+// even after the node is reused.
+typedef uint64_t TimerHandle;
+
+void tw_init(TimerWheel*, uint64_t now);
+TimerHandle tw_add(TimerWheel*, uint64_t when, int topic); // a time already past fires on the next advance
+int tw_cancel(TimerWheel*, TimerHandle); // 0, -1 if not pending
+int tw_reschedule(TimerWheel*, TimerHandle, uint64_t when); // 0, -1 if not pending
+size_t tw_advance(TimerWheel*, uint64_t upto, int* out, size_t max); // fires everything due by upto into out, max at a time; returns how many
+void tw_free(TimerWheel*);
+
 // Tree (simple subject->topics)
 typedef struct TreeNode {
 	char label[128];
@@ -76,5 +204,85 @@ void graph_init(Graph*, int n);
 void graph_add_edge(Graph*, int u, int v);
 int graph_indegree(Graph*, int v);
 
+// Dependency graph for any number of topics: edge u -> v means u comes
+// before v. Edges are kept in insertion order plus a hash set that drops
+// duplicates; indegree/outdegree are updated per edge. Forward and reverse
+// CSR adjacency are rebuilt in O(n + m) on first use after a change.
+typedef struct DepGraph {
+	int n, cap;
+	int* indeg;
+	int* outdeg;
+	int* eu; // edge list
+	int* ev;
+	size_t m, mcap;
+	uint64_t* eset; // open addressing over (u << 32 | v) + 1, 0 = empty
+	size_t esetCap;
+	int* fwdOff; // successors of u: fwd[fwdOff[u] .. fwdOff[u+1])
+	int* fwd;
+	int* revOff; // predecessors of v: rev[revOff[v] .. revOff[v+1])
+	int* rev;
+	bool dirty;
+	uint64_t version; // bumped by every added topic or edge
+} DepGraph;
+
+void dg_init(DepGraph*);
+int dg_add_vertex(DepGraph*);
+void dg_resize(DepGraph*, int n);
+int dg_add_edge(DepGraph*, int u, int v); // 1 added, 0 already there, -1 bad vertex
+int dg_indegree(const DepGraph*, int v);
+const int* dg_successors(DepGraph*, int u, int* count);
+const int* dg_predecessors(DepGraph*, int v, int* count);
+int dg_topo_order(DepGraph*, int* out); // fills out[n]; returns how many, < n if there is a cycle
+int dg_find_cycle(DepGraph*, int* out); // a cycle in edge order, returns its length (0 if none)
+void dg_free(DepGraph*);
+
+// Kahn scheduler over a DepGraph: next hands out a topic whose prerequisites
+// are all done, done(v) unlocks what v was blocking. next is O(1) and
+// done O(outdegree). It copies the successor lists at sched_init and keeps
+// working on that copy: topics and edges added later are not scheduled.
+typedef struct StudyScheduler {
+	int n;        // topics in the graph at sched_init
+	int* pending; // prerequisites not done yet
+	int* ready;   // FIFO; every topic enters at most once
+	int head, tail;
+	int* succOff; // successors of v: succ[succOff[v] .. succOff[v+1])
+	int* succ;
+	unsigned char* state; // SCHED_WAITING .. SCHED_DONE per topic
+} StudyScheduler;
+
+enum { SCHED_WAITING, SCHED_READY, SCHED_STUDYING, SCHED_DONE };
+
+void sched_init(StudyScheduler*, DepGraph*);
+int sched_next(StudyScheduler*); // -1 when nothing is ready
+int sched_done(StudyScheduler*, int v); // 0, -1 unless v came from sched_next and is not done yet
+void sched_free(StudyScheduler*);
+
+// Reachability index over an acyclic DepGraph: one bitset row per topic for
+// everything that must come before it and one for everything it unlocks,
+// n * n / 4 bytes in all (25 MB for 10k topics). Built in topological order
+// by OR-ing predecessor rows; an added edge ORs its two closures into the
+// rows it affects, and one that would close a cycle is refused in O(1).
+// The index remembers the graph's version: if topics or edges were added
+// some other way than reach_add_edge, the next query or reach_add_edge
+// rebuilds it first (and, if the graph now has a cycle, answers as empty).
+// A studied set is a bitset over the same topic indices (TopicStore.studied).
+typedef struct ReachIndex {
+	int n;
+	size_t words; // per row
+	uint64_t* before; // row v: topics that must be done before v
+	uint64_t* after;  // row u: topics that depend on u
+	DepGraph* graph;  // built from, NULL before reach_build
+	uint64_t version; // graph->version the rows reflect
+} ReachIndex;
+
+void reach_init(ReachIndex*);
+int reach_build(ReachIndex*, DepGraph*); // 0, or -1 if the graph has a cycle
+int reach_add_edge(ReachIndex*, DepGraph*, int u, int v); // 1 added, 0 already there, -1 bad vertex or cycle
+bool reach_requires(ReachIndex*, int v, int u); // u must be done before v
+bool reach_ready(ReachIndex*, int v, const uint64_t* studied); // every prerequisite of v studied
+size_t reach_blocking(ReachIndex*, int v, const uint64_t* studied, int* out, size_t max); // unstudied prerequisites; returns their count, lists up to max
+size_t reach_unlocks(ReachIndex*, int u, int* out, size_t max); // everything depending on u
+void reach_free(ReachIndex*);
+
 #endif
 
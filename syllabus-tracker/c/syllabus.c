@@ -13,6 +13,15 @@ static Topic make_topic(const char* title, const char* date, const char* url) {
 	return t;
 }
 
+// Minutes since 1970-01-01 for "YYYY-MM-DD" (civil-from-days, March-based years).
+static uint64_t date_minutes(const char* date) {
+	int y, m, d;
+	if (sscanf(date, "%d-%d-%d", &y, &m, &d) != 3) return 0;
+	y -= m <= 2;
+	long era = y / 400, yoe = y - era * 400, doy = (153L * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	return (uint64_t)(era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468) * 1440;
+}
+
 int main(void) {
 	printf("Syllabus Tracker (C CLI demo)\n");
 
@@ -31,6 +40,17 @@ int main(void) {
 	printf("Undo last note: %s\n", lastNote ? lastNote : "(none)");
 	free(lastNote);
 
+	// Notes history: each version kept as the edit against the next one
+	NotesHistory history; notes_init(&history, "Start with graphs");
+	notes_save(&history, "Start with graphs, then trees");
+	notes_save(&history, "Start with graphs, then trees and heaps");
+	printf("Note: %s\n", notes_current(&history));
+	notes_undo(&history);
+	printf("Undo: %s\n", notes_current(&history));
+	char* firstNote = notes_version(&history, 0);
+	printf("First version: %s (%zu versions kept)\n", firstNote, history.count);
+	free(firstNote);
+
 	// Reminder queue (toy) epoch-days
 	Queue rem; queue_init(&rem);
 	queue_enqueue(&rem, 20251101);
@@ -55,9 +75,51 @@ int main(void) {
 		printf("- %s (planned: %s) res: %s\n", n->value.title, n->value.plannedDate, n->value.resourceUrl);
 	}
 
+	// Topic store: same topics, flags as bitsets
+	TopicStore store; ts_init(&store);
+	for (ListNode* n = topics.head; n; n = n->next) ts_append(&store, n->value.title, n->value.plannedDate, n->value.resourceUrl);
+	ts_set_taught(&store, 0, true); ts_set_taught(&store, 1, true);
+	ts_set_studied(&store, 0, true);
+	printf("Progress: %zu/%zu taught, %zu/%zu studied (first: %s)\n", ts_count_taught(&store), store.count,
+		ts_count_studied(&store), store.count, ts_title(&store, 0));
+
+	// Dependency graph over the topic store: a study order, then a cycle
+	DepGraph deps; dg_init(&deps); dg_resize(&deps, (int)store.count);
+	dg_add_edge(&deps, 0, 1); dg_add_edge(&deps, 1, 2); dg_add_edge(&deps, 0, 2);
+	int order[3], cycle[3];
+	int ordered = dg_topo_order(&deps, order);
+	printf("Study order:");
+	for (int i = 0; i < ordered; ++i) printf(" %s%s", i ? "-> " : "", ts_title(&store, (size_t)order[i]));
+	printf("\n");
+	ReachIndex reach; reach_init(&reach); reach_build(&reach, &deps);
+	int blocking[3];
+	size_t nblocking = reach_blocking(&reach, 2, store.studied, blocking, 3);
+	printf("Before %s: %zu prerequisite(s) not studied, e.g. %s\n", ts_title(&store, 2), nblocking,
+		nblocking ? ts_title(&store, (size_t)blocking[0]) : "-");
+	printf("Trees -> Intro to Graphs via the index: %s\n", reach_add_edge(&reach, &deps, 2, 0) < 0 ? "refused, would be a cycle" : "added");
+	reach_free(&reach);
+	dg_add_edge(&deps, 2, 0);
+	int clen = dg_find_cycle(&deps, cycle);
+	printf("After adding Trees -> Intro to Graphs: %d of %d ordered, cycle of %d\n", dg_topo_order(&deps, order), deps.n, clen);
+	dg_free(&deps);
+
+	// Reminder wheel: one reminder per planned date, in minutes
+	TimerWheel wheel; tw_init(&wheel, date_minutes("2025-10-31"));
+	TimerHandle reminder[3]; int due[3];
+	for (size_t i = 0; i < store.count; ++i) reminder[i] = tw_add(&wheel, date_minutes(ts_planned_date(&store, i)), (int)i);
+	ts_set_planned_date(&store, 2, "2025-11-02");
+	tw_reschedule(&wheel, reminder[2], date_minutes(ts_planned_date(&store, 2)));
+	size_t ndue = tw_advance(&wheel, date_minutes("2025-11-02"), due, 3);
+	printf("Due by 2025-11-02:");
+	for (size_t i = 0; i < ndue; ++i) printf(" %s (%s);", ts_title(&store, (size_t)due[i]), ts_planned_date(&store, (size_t)due[i]));
+	printf(" %zu still pending\n", wheel.pending);
+	tw_free(&wheel);
+
 	// Cleanup
+	ts_free(&store);
 	ll_free(&topics);
 	stack_free(&notes);
+	notes_free(&history);
 	queue_free(&rem);
 	tree_free(subj);
 	return 0;